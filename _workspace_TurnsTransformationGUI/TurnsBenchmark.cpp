@@ -0,0 +1,96 @@
+// Turns Transformation Tool - Batch Expansion Benchmark
+// Measures notes/second of the scalar and AVX2 expandTurnsBatch kernels
+// on a synthetic corpus and checks that both produce identical output.
+//
+// Usage: TurnsBenchmark [note_count] [repetitions]
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cstdint>
+#include <cstdlib>
+#include <iterator>
+
+#include "TurnsTransformation.h"
+
+// Variants from every pattern family
+const char* const BENCHMARK_VARIANTS[] = {
+    "Turn", "FTurnF", "BTurnS", "FBTurnF", "FBTurnSS", "FBTurnSF", "BNT", "BNFBTurnFS",
+    "BNBTurnS", "TT", "TFBTurnFF", "TBTurnS", "P32T", "P32FBTurnSF", "ST", "SFBTurnFS"
+};
+
+// Expand the corpus `repetitions` times and return the best notes/second
+double measureKernel(BatchKernel kernel, const std::vector<int>& pitches, const std::vector<int>& durations,
+                     const std::vector<VariantId>& variants, const std::vector<TimeMeter>& meters,
+                     int repetitions, TurnBatch& batch) {
+    double best = 0.0;
+    for (int run = 0; run < repetitions; ++run) {
+        auto start = std::chrono::steady_clock::now();
+        expandTurnsBatch(pitches.data(), durations.data(), variants.data(), meters.data(),
+                         pitches.size(), batch, kernel);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        double notesPerSecond = pitches.size() / elapsed.count();
+        if (notesPerSecond > best) {
+            best = notesPerSecond;
+        }
+    }
+    return best;
+}
+
+int main(int argc, char* argv[]) {
+    std::size_t noteCount = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+    int repetitions = argc > 2 ? std::atoi(argv[2]) : 5;
+
+    // Synthetic corpus: playable pitches, typical tick durations, mixed variants and meters
+    std::mt19937 generator(20250101);
+    std::uniform_int_distribution<int> pitchDistribution(24, 108);
+    std::uniform_int_distribution<int> durationDistribution(1, 4096);
+    std::uniform_int_distribution<int> variantDistribution(0, std::size(BENCHMARK_VARIANTS) - 1);
+    std::uniform_int_distribution<int> meterDistribution(0, 1);
+
+    std::vector<int> pitches(noteCount);
+    std::vector<int> durations(noteCount);
+    std::vector<VariantId> variants(noteCount);
+    std::vector<TimeMeter> meters(noteCount);
+    for (std::size_t i = 0; i < noteCount; ++i) {
+        pitches[i] = pitchDistribution(generator);
+        durations[i] = durationDistribution(generator);
+        variants[i] = findVariantId(BENCHMARK_VARIANTS[variantDistribution(generator)]);
+        meters[i] = meterDistribution(generator) == 0 ? DUPLE : TRIPLE;
+    }
+
+    std::cout << "Notes: " << noteCount << ", repetitions: " << repetitions << "\n";
+
+    TurnBatch scalarBatch;
+    double scalarRate = measureKernel(BatchKernel::Scalar, pitches, durations, variants, meters,
+                                      repetitions, scalarBatch);
+    std::cout << "Scalar: " << static_cast<long long>(scalarRate) << " notes/s\n";
+
+    if (!batchKernelAvailable(BatchKernel::Avx2)) {
+        std::cout << "AVX2:   not supported on this CPU\n";
+        return 0;
+    }
+
+    TurnBatch avx2Batch;
+    double avx2Rate = measureKernel(BatchKernel::Avx2, pitches, durations, variants, meters,
+                                    repetitions, avx2Batch);
+    std::cout << "AVX2:   " << static_cast<long long>(avx2Rate) << " notes/s"
+              << " (" << avx2Rate / scalarRate << "x)\n";
+
+    // Both kernels must produce the same expansion
+    bool identical = scalarBatch.offsets == avx2Batch.offsets &&
+                     scalarBatch.segments.size() == avx2Batch.segments.size();
+    for (std::size_t i = 0; identical && i < scalarBatch.segments.size(); ++i) {
+        identical = scalarBatch.segments[i].pitch == avx2Batch.segments[i].pitch &&
+                    scalarBatch.segments[i].duration == avx2Batch.segments[i].duration;
+    }
+    if (!identical) {
+        std::cerr << "Error: scalar and AVX2 expansions differ\n";
+        return 1;
+    }
+    std::cout << "Outputs identical.\n";
+    return 0;
+}
@@ -4,8 +4,12 @@
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <deque>
+#include <filesystem>
 #include <algorithm>
 #include <random>
 #include <chrono>
@@ -14,46 +18,202 @@
 #include <stdexcept>
 #include <cstdlib>
 #include <cstring>
+#include <cerrno>
 #include <memory>
+#include <array>
+#include <cstdint>
+#include <cmath>
+#include <charconv>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+#include "TurnsTransformation.h"
+
+// Memory-mapped input files
+#if defined(_WIN32) || defined(_WIN64)
+    #ifndef NOMINMAX
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+// SIMD support for the batch turn expansion (selected at runtime)
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+    #define TURNS_HAVE_X86
+    #include <immintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #endif
+    #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #define TURNS_HAVE_SSE2
+    #endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+    #define TURNS_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+    #define TURNS_TARGET_AVX2
+#endif
+
+// Note name of a MIDI number in a fixed 8-byte slot: the name padded with spaces
+// to NOTE_NAME_WIDTH, so writers can copy it without measuring or allocating
+constexpr int NOTE_NAME_WIDTH = 7;
+
+struct NoteNameText {
+    char text[NOTE_NAME_WIDTH];
+    std::uint8_t length;
+};
+
+// Build one table entry, e.g. 61 -> "C#4", 0 -> "C-1"
+constexpr NoteNameText makeNoteNameText(int noteNumber) {
+    constexpr const char* letters[] = {"C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"};
+    NoteNameText name{{' ', ' ', ' ', ' ', ' ', ' ', ' '}, 0};
+    for (const char* c = letters[noteNumber % 12]; *c != '\0'; ++c) {
+        name.text[name.length++] = *c;
+    }
+    int octave = noteNumber / 12 - 1;
+    if (octave < 0) {
+        name.text[name.length++] = '-';
+        octave = -octave;
+    }
+    name.text[name.length++] = static_cast<char>('0' + octave);
+    return name;
+}
+
+// Number of MIDI pitches, 0-127
+constexpr int MIDI_PITCH_COUNT = 128;
+
+constexpr std::array<NoteNameText, MIDI_PITCH_COUNT> makeNoteNameTable() {
+    std::array<NoteNameText, MIDI_PITCH_COUNT> table{};
+    for (int noteNumber = 0; noteNumber < MIDI_PITCH_COUNT; ++noteNumber) {
+        table[noteNumber] = makeNoteNameText(noteNumber);
+    }
+    return table;
+}
+
+constexpr std::array<NoteNameText, MIDI_PITCH_COUNT> NOTE_NAME_TABLE = makeNoteNameTable();
+
+// Written for pitches outside 0-127
+constexpr NoteNameText INVALID_NOTE_NAME = {{'?', '?', ' ', ' ', ' ', ' ', ' '}, 2};
+
+static_assert(sizeof(NoteNameText) == 8, "note names are copied as 8-byte slots");
+
+constexpr const NoteNameText& noteNameText(int noteNumber) {
+    return static_cast<unsigned>(noteNumber) < MIDI_PITCH_COUNT ? NOTE_NAME_TABLE[noteNumber] : INVALID_NOTE_NAME;
+}
+
+constexpr std::string_view noteNameView(int noteNumber) {
+    const NoteNameText& name = noteNameText(noteNumber);
+    return std::string_view(name.text, name.length);
+}
 
 // Helper to get note name (from MIDI number)
 std::string getNoteName(int noteNumber) {
-    static const std::string noteNames[] = {
-        "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"
-    };
-    int octave = noteNumber / 12 - 1;
-    int noteIndex = noteNumber % 12;
-    return noteNames[noteIndex] + std::to_string(octave);
+    return std::string(noteNameView(noteNumber));
 }
 
-// Helper to get MIDI number from note name
-int getNoteNumber(const std::string& noteName) {
-    static const std::string noteNames[] = {
-        "C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"
-    };
+// Why a note name could not be parsed
+enum class NoteParseError : std::uint8_t {
+    None,
+    InvalidName,    // Not a letter A-G with valid accidentals
+    InvalidOctave,  // Missing or malformed octave number
+    OutOfRange      // Parsed, but outside MIDI pitches 0-127
+};
+
+// Semitone of each letter A-G above C
+constexpr std::array<int, 7> LETTER_SEMITONES = {9, 11, 0, 2, 4, 5, 7};
+
+// Semitone step of each accidental character: '#' sharp, 'b' flat, 'x' double sharp
+constexpr std::array<std::int8_t, 256> makeAccidentalSteps() {
+    std::array<std::int8_t, 256> steps{};
+    steps['#'] = 1;
+    steps['b'] = -1;
+    steps['x'] = 2;
+    return steps;
+}
 
-    // Extract note and octave
-    std::string baseNote = noteName.substr(0, noteName.size() - 1);
-    int octave = std::stoi(noteName.substr(noteName.size() - 1));
+constexpr std::array<std::int8_t, 256> ACCIDENTAL_STEPS = makeAccidentalSteps();
 
-    // Find base note index
-    auto it = std::find(std::begin(noteNames), std::end(noteNames), baseNote);
-    if (it == std::end(noteNames)) {
-        throw std::invalid_argument("Invalid note name: " + noteName);
+// Parse a note name such as "C4", "F#3", "Bb2", "Ebb5", "Fx1" or "C-1" into a MIDI
+// number. Accidentals may be doubled ("##", "bb"); octaves run from -1 to 9.
+// The octave belongs to the letter, so "Cb4" is 59 and "B#3" is 60.
+NoteParseError parseNoteName(std::string_view noteName, int& noteNumber) {
+    unsigned letter = noteName.empty() ? 7u : static_cast<unsigned char>(noteName[0]) - 'A';
+    if (letter >= LETTER_SEMITONES.size()) {
+        return NoteParseError::InvalidName;
     }
-    int noteIndex = std::distance(std::begin(noteNames), it);
+    int pitch = LETTER_SEMITONES[letter];
+
+    std::size_t position = 1;
+    int first = position < noteName.size() ? ACCIDENTAL_STEPS[static_cast<unsigned char>(noteName[position])] : 0;
+    position += first != 0;
+    // Only a single sharp or flat may be doubled
+    int second = first * first == 1 && position < noteName.size() &&
+                 ACCIDENTAL_STEPS[static_cast<unsigned char>(noteName[position])] == first ? first : 0;
+    position += second != 0;
+    pitch += first + second;
+
+    const char* octaveEnd = noteName.data() + noteName.size();
+    int octave = 0;
+    auto [end, error] = std::from_chars(noteName.data() + position, octaveEnd, octave);
+    if (error == std::errc::result_out_of_range) {
+        return NoteParseError::OutOfRange;
+    }
+    if (error != std::errc() || end != octaveEnd) {
+        // A character after the letter that starts neither an accidental nor a number
+        bool badAccidental = end == noteName.data() + position && position < noteName.size() &&
+                             noteName[position] != '-' && (noteName[position] < '0' || noteName[position] > '9');
+        return badAccidental ? NoteParseError::InvalidName : NoteParseError::InvalidOctave;
+    }
+
+    int number = (octave + 1) * 12 + pitch;
+    if (octave < -1 || octave > 9 || number < 0 || number > 127) {
+        return NoteParseError::OutOfRange;
+    }
+    noteNumber = number;
+    return NoteParseError::None;
+}
 
-    return (octave + 1) * 12 + noteIndex;
+// Message for a note that failed to parse
+std::string noteParseErrorMessage(NoteParseError error, std::string_view noteName) {
+    switch (error) {
+        case NoteParseError::InvalidName:
+            return "Invalid note name: " + std::string(noteName);
+        case NoteParseError::InvalidOctave:
+            return "Invalid octave in note name: " + std::string(noteName);
+        case NoteParseError::OutOfRange:
+            return "Note outside the MIDI range: " + std::string(noteName);
+        default:
+            return std::string();
+    }
 }
 
-// Enum for TimeMeter
-enum TimeMeter {
-    DUPLE,
-    TRIPLE
+// Maximum number of segments a single turn variant expands to
+constexpr int MAX_TURN_SEGMENTS = 6;
+
+// Fixed-capacity output for one turn expansion, filled without heap allocation.
+// Offers push_back so the handleTurnMeter* helpers can fill it like a vector.
+struct TurnExpansion {
+    std::array<Segment, MAX_TURN_SEGMENTS> segments{};
+    int count = 0;
+
+    constexpr void clear() { count = 0; }
+    constexpr void push_back(const Segment& segment) { segments[count++] = segment; }
+    const Segment* begin() const { return segments.data(); }
+    const Segment* end() const { return segments.data() + count; }
 };
 
-// Helper functions for Turn variants
-void handleTurnMeter(std::vector<std::pair<int, int>>& EmbRet, int upper, int principal, int lower, int pi, int durPi, TimeMeter meter) {
+// Helper functions for Turn variants.
+// Output is a std::vector<std::pair<int, int>>, a TurnExpansion or a SegmentWriter.
+// With a TurnExpansion they can run at compile time (see SEGMENT_LAYOUTS).
+template <typename Output>
+constexpr void handleTurnMeter(Output& EmbRet, int upper, int principal, int lower, int pi, int durPi, TimeMeter meter) {
     if (meter == DUPLE) {
         int segment = durPi / 4;
         EmbRet.push_back({upper, segment});
@@ -69,7 +229,8 @@ void handleTurnMeter(std::vector<std::pair<int, int>>& EmbRet, int upper, int pr
     }
 }
 
-void handleTurnMeterFB(std::vector<std::pair<int, int>>& EmbRet, int upper, int pi, int lower, int underlower, int lower2, int pi2, int durPi, TimeMeter meter) {
+template <typename Output>
+constexpr void handleTurnMeterFB(Output& EmbRet, int upper, int pi, int lower, int underlower, int lower2, int pi2, int durPi, TimeMeter meter) {
     if (meter == DUPLE) {
         int segment = durPi / 8;
         EmbRet.push_back({upper, segment});
@@ -88,7 +249,8 @@ void handleTurnMeterFB(std::vector<std::pair<int, int>>& EmbRet, int upper, int
     }
 }
 
-void handleTurnMeterBetween(std::vector<std::pair<int, int>>& EmbRet, int pi, int upper, int pi2, int lower, int pi3, int durPi, TimeMeter meter) {
+template <typename Output>
+constexpr void handleTurnMeterBetween(Output& EmbRet, int pi, int upper, int pi2, int lower, int pi3, int durPi, TimeMeter meter) {
     if (meter == DUPLE) {
         int segment = durPi / 8;
         EmbRet.push_back({pi, durPi / 2});
@@ -106,7 +268,8 @@ void handleTurnMeterBetween(std::vector<std::pair<int, int>>& EmbRet, int pi, in
     }
 }
 
-void handleTurnMeterTrille(std::vector<std::pair<int, int>>& EmbRet, int upper, int principal, int lower, int durPi, TimeMeter meter) {
+template <typename Output>
+constexpr void handleTurnMeterTrille(Output& EmbRet, int upper, int principal, int lower, int durPi, TimeMeter meter) {
     if (meter == DUPLE) {
         int segment = durPi / 8;
         EmbRet.push_back({upper, segment});
@@ -126,7 +289,8 @@ void handleTurnMeterTrille(std::vector<std::pair<int, int>>& EmbRet, int upper,
     }
 }
 
-void handleTurnMeterP32(std::vector<std::pair<int, int>>& EmbRet, int upper, int principal, int lower, int durPi, TimeMeter meter) {
+template <typename Output>
+constexpr void handleTurnMeterP32(Output& EmbRet, int upper, int principal, int lower, int durPi, TimeMeter meter) {
     if (meter == DUPLE) {
         int segment1 = (durPi * 3) / 8;
         int segment2 = durPi / 8;
@@ -144,7 +308,8 @@ void handleTurnMeterP32(std::vector<std::pair<int, int>>& EmbRet, int upper, int
     }
 }
 
-void handleTurnMeterSnapped(std::vector<std::pair<int, int>>& EmbRet, int upper, int principal, int lower, int durPi, TimeMeter meter) {
+template <typename Output>
+constexpr void handleTurnMeterSnapped(Output& EmbRet, int upper, int principal, int lower, int durPi, TimeMeter meter) {
     if (meter == DUPLE) {
         int segment = durPi / 6;
         EmbRet.push_back({upper, segment});
@@ -160,735 +325,3478 @@ void handleTurnMeterSnapped(std::vector<std::pair<int, int>>& EmbRet, int upper,
     }
 }
 
-// Main function to apply turn variants
-std::vector<std::pair<int, int>> applyTurnVariants(int pi, int durPi, TimeMeter meter, const std::string& variant) {
-    if (durPi <= 0) {
-        throw std::invalid_argument("Duration (durPi) must be greater than 0");
-    }
-    if (meter != DUPLE && meter != TRIPLE) {
-        throw std::invalid_argument("Invalid TimeMeter");
-    }
+// Identifiers for every turn variant, in the order of TURN_VARIANT_TABLE
+enum class VariantId : std::uint8_t {
+    // Basic Turn variants
+    Turn,
+    FTurnF,
+    FTurnS,
+    BTurnF,
+    BTurnS,
 
-    std::vector<std::pair<int, int>> EmbRet;
+    // Front and Back Turn variants
+    FBTurnF,
+    FBTurnS,
+    FBTurnFF,
+    FBTurnSS,
+    FBTurnFS,
+    FBTurnSF,
+
+    // Between Notes Turn variants
+    BNT,
+    BNFTurnF,
+    BNFTurnS,
+    BNBTurn,
+    BNBTurnS,
+    BNFBTurnF,
+    BNFBTurnS,
+    BNFBTurnFF,
+    BNFBTurnSS,
+    BNFBTurnFS,
+    BNFBTurnSF,
+
+    // Trilled Turn variants
+    TT,
+    TFTurnF,
+    TFTurnS,
+    TBTurnF,
+    TBTurnS,
+    TFBTurnF,
+    TFBTurnS,
+    TFBTurnFF,
+    TFBTurnSS,
+    TFBTurnFS,
+    TFBTurnSF,
+
+    // P32 Turn variants
+    P32T,
+    P32FTurnF,
+    P32FTurnS,
+    P32BTurnF,
+    P32BTurnS,
+    P32FBTurnF,
+    P32FBTurnS,
+    P32FBTurnFF,
+    P32FBTurnSS,
+    P32FBTurnFS,
+    P32FBTurnSF,
+
+    // Snapped Turn variants
+    ST,
+    SFTurnF,
+    SFTurnS,
+    SBTurnF,
+    SBTurnS,
+    SFBTurnF,
+    SFBTurnS,
+    SFBTurnFF,
+    SFBTurnSS,
+    SFBTurnFS,
+    SFBTurnSF,
+
+    Count  // Number of variants, also used as "unknown variant"
+};
+
+// Pattern family of a variant - selects the handleTurnMeter* helper that expands it
+enum class PatternFamily : std::uint8_t {
+    Meter,
+    FB,
+    Between,
+    Trille,
+    P32,
+    Snapped
+};
 
+// Compile-time description of a turn variant. TURN_VARIANT_TABLE is the static
+// catalog of all variants. Offsets are in semitones relative to the principal note.
+struct VariantSpec {
+    VariantId id;
+    std::string_view name;
+    std::string_view description;  // Short description shown to users
+    PatternFamily family;
+    int upperOffset;
+    int lowerOffset;
+    int underLowerOffset;  // Only used by the FB family
+};
+
+constexpr int VARIANT_COUNT = static_cast<int>(VariantId::Count);
+
+constexpr VariantSpec TURN_VARIANT_TABLE[] = {
     // Basic Turn variants
-    if (variant == "Turn") {  // whole step above, the principal note, and the lower auxiliary (1/2 step below) are played rapidly, resolve and hold for duration
-        int upper = pi + 2;  // whole step above
-        int lower = pi - 1;  // 1/2 step below
-        handleTurnMeter(EmbRet, upper, pi, lower, pi, durPi, meter);
-    } else if (variant == "FTurnF") {  // 1/2 step above, the principal note, and the lower auxiliary (1 whole step below) are played, resolve and hold for duration
-        int upper = pi + 1;  // 1/2 step above
-        int lower = pi - 2;  // 1 whole step below
-        handleTurnMeter(EmbRet, upper, pi, lower, pi, durPi, meter);
-    } else if (variant == "FTurnS") {  // 1 whole step above, the principal note, and the lower auxiliary (1 whole step below) are played, resolve and hold for duration
-        int upper = pi + 2;  // 1 whole step above
-        int lower = pi - 2;  // 1 whole step below
-        handleTurnMeter(EmbRet, upper, pi, lower, pi, durPi, meter);
-    } else if (variant == "BTurnF") {  // whole step above, the principal note, and the lower auxiliary (1/2 step below) are played, resolve and hold for duration
-        int upper = pi + 2;  // whole step above
-        int lower = pi - 1;  // 1/2 step below
-        handleTurnMeter(EmbRet, upper, pi, lower, pi, durPi, meter);
-    } else if (variant == "BTurnS") {  // whole step above, the principal note, and the lower auxiliary (1 whole below) are played, resolve and hold for duration
-        int upper = pi + 2;  // whole step above
-        int lower = pi - 2;  // 1 whole step below
-        handleTurnMeter(EmbRet, upper, pi, lower, pi, durPi, meter);
+    {VariantId::Turn, "Turn", "Whole step above, principal note, half step below", PatternFamily::Meter, 2, -1, 0},  // whole step above, the principal note, and the lower auxiliary (1/2 step below) are played rapidly, resolve and hold for duration
+    {VariantId::FTurnF, "FTurnF", "Half step above, principal note, whole step below", PatternFamily::Meter, 1, -2, 0},  // 1/2 step above, the principal note, and the lower auxiliary (1 whole step below) are played, resolve and hold for duration
+    {VariantId::FTurnS, "FTurnS", "Whole step above, principal note, whole step below", PatternFamily::Meter, 2, -2, 0},  // 1 whole step above, the principal note, and the lower auxiliary (1 whole step below) are played, resolve and hold for duration
+    {VariantId::BTurnF, "BTurnF", "Whole step above, principal note, half step below", PatternFamily::Meter, 2, -1, 0},  // whole step above, the principal note, and the lower auxiliary (1/2 step below) are played, resolve and hold for duration
+    {VariantId::BTurnS, "BTurnS", "Whole step above, principal note, whole step below", PatternFamily::Meter, 2, -2, 0},  // whole step above, the principal note, and the lower auxiliary (1 whole below) are played, resolve and hold for duration
 
     // Front and Back Turn variants
-    } else if (variant == "FBTurnF") {  // 1/2 step above, the principle note, and the lower turn is 1/2 step below the principal
-        int upper = pi + 1;  // 1/2 step above
-        int lower = pi - 1;  // 1/2 step below
-        int underlower = pi - 4;
-        handleTurnMeterFB(EmbRet, upper, pi, lower, underlower, lower, pi, durPi, meter);
-    } else if (variant == "FBTurnS") {  // 1/2 step above, the principle note, and the lower turn is 1 whole step below the principal
-        int upper = pi + 1;  // 1/2 step above
-        int lower = pi - 2;
-        int underlower = pi - 4; // 1 whole step below
-        handleTurnMeterFB(EmbRet, upper, pi, lower, underlower, lower, pi, durPi, meter);
-    } else if (variant == "FBTurnFF") {  // front and back of turn - both pre and post principal note are 1/2 step above and below
-        int upper = pi + 1;  // 1/2 step above
-        int lower = pi - 1;
-        int underlower = pi - 3;// 1/2 step below
-        handleTurnMeterFB(EmbRet, upper, pi, lower, underlower, lower, pi, durPi, meter);
-    } else if (variant == "FBTurnSS") {  // front and back of turn - both pre and post principal note are 1 whole step above and below
-        int upper = pi + 2;  // 1 whole step above
-        int lower = pi - 2;
-        int underlower = pi - 4;// 1 whole step below
-        handleTurnMeterFB(EmbRet, upper, pi, lower, underlower, lower, pi, durPi, meter);
-    } else if (variant == "FBTurnFS") {  // front and back of turn, the front is 1/2 step above, the back is 1 whole step below
-        int upper = pi + 1;  // 1/2 step above
-        int lower = pi - 2;
-        int underlower = pi - 4;// 1 whole step below
-        handleTurnMeterFB(EmbRet, upper, pi, lower, underlower, lower, pi, durPi, meter);
-    } else if (variant == "FBTurnSF") {  // front and back of turn, the front is 1 whole step above, the back is 1/2 step below
-        int upper = pi + 2;  // 1 whole step above
-        int lower = pi - 1;
-        int underlower = pi - 4;// 1/2 step below
-        handleTurnMeterFB(EmbRet, upper, pi, lower, underlower, lower, pi, durPi, meter);
+    {VariantId::FBTurnF, "FBTurnF", "Half step above, principal, half step below", PatternFamily::FB, 1, -1, -4},  // 1/2 step above, the principle note, and the lower turn is 1/2 step below the principal
+    {VariantId::FBTurnS, "FBTurnS", "Half step above, principal, whole step below", PatternFamily::FB, 1, -2, -4},  // 1/2 step above, the principle note, and the lower turn is 1 whole step below the principal
+    {VariantId::FBTurnFF, "FBTurnFF", "Front/back - half step above/below", PatternFamily::FB, 1, -1, -3},  // front and back of turn - both pre and post principal note are 1/2 step above and below
+    {VariantId::FBTurnSS, "FBTurnSS", "Front/back - whole step above/below", PatternFamily::FB, 2, -2, -4},  // front and back of turn - both pre and post principal note are 1 whole step above and below
+    {VariantId::FBTurnFS, "FBTurnFS", "Front half step, back whole step", PatternFamily::FB, 1, -2, -4},  // front and back of turn, the front is 1/2 step above, the back is 1 whole step below
+    {VariantId::FBTurnSF, "FBTurnSF", "Front whole step, back half step", PatternFamily::FB, 2, -1, -4},  // front and back of turn, the front is 1 whole step above, the back is 1/2 step below
 
     // Between Notes Turn variants
-    } else if (variant == "BNT") {  // Turn between principal notes, regular
-        int upper = pi + 2;  // whole step above
-        int lower = pi - 1;  // 1/2 step below
-        handleTurnMeterBetween(EmbRet, pi, upper, pi, lower, pi,  durPi, meter);
-    } else if (variant == "BNFTurnF") {  // Turn between Notes 1/2 step above, the principal note, and the lower auxiliary (1/2 step below) are played, resolve and hold for duration
-        int upper = pi + 1;  // 1/2 step above
-        int lower = pi - 1;  // 1/2 step below
-        handleTurnMeterBetween(EmbRet, pi, upper, pi, lower, pi,  durPi, meter);
-    } else if (variant == "BNFTurnS") {  // Turn between Notes 1 whole step above, the principal note, and the lower auxiliary (1 whole step below) are played, resolve and hold for duration
-        int upper = pi + 2;  // 1 whole step above
-        int lower = pi - 2;  // 1 whole step below
-        handleTurnMeterBetween(EmbRet, pi, upper, pi, lower, pi,  durPi, meter);
-    } else if (variant == "BNBTurn") {  // Between principal notes, 1 whole step above, the principal note, and the lower auxiliary (1 whole step below) are played, resolve and hold for duration
-        int upper = pi + 1;  // 1 whole step above
-        int lower = pi - 2;  // 1 whole step below
-        handleTurnMeterBetween(EmbRet, pi, upper, pi, lower, pi,  durPi, meter);
-    } else if (variant == "BNBTurnS") {  // Between principal notes, whole step above, the principal note, and the lower auxiliary (1 whole below) are played, resolve and hold for duration
-        int upper = pi + 1;  // whole step above
-        int lower = pi - 3;  // 1 whole step below
-        handleTurnMeterBetween(EmbRet, pi, upper, pi, lower, pi,  durPi, meter);
-    } else if (variant == "BNFBTurnF") {  // Between principal notes,1/2 step above, the principle note, and the lower turn is 1/2 step below the principal
-        int upper = pi + 3;  // 1/2 step above
-        int lower = pi - 1;  // 1/2 step below
-        handleTurnMeterBetween(EmbRet, pi, upper, pi, lower, pi,  durPi, meter);
-    } else if (variant == "BNFBTurnS") {  // Between principal notes, 1/2 step above, the principle note, and the lower turn is 1 whole step below the principal
-        int upper = pi + 3;  // 1/2 step above
-        int lower = pi - 2;  // 1 whole step below
-        handleTurnMeterBetween(EmbRet, pi, upper, pi, lower, pi,  durPi, meter);
-    } else if (variant == "BNFBTurnFF") {  // Between principal notes,front and back of turn - both pre and post principal note are 1/2 step above and below
-        int upper = pi + 2;  // 1/2 step above
-        int lower = pi - 3;  // 1/2 step below
-        handleTurnMeterBetween(EmbRet, pi, upper, pi, lower, pi,  durPi, meter);
-    } else if (variant == "BNFBTurnSS") {  // Between principal notes, front and back of turn - both pre and post principal note are 1 whole step above and below
-        int upper = pi + 4;  // 1 whole step above
-        int lower = pi - 2;  // 1 whole step below
-        handleTurnMeterBetween(EmbRet, pi, upper, pi, lower, pi,  durPi, meter);
-    } else if (variant == "BNFBTurnFS") {  // Between principal notes,front and back of turn, the front is 1/2 step above, the back is 1 whole step below
-        int upper = pi + 2;  // 1/2 step above
-        int lower = pi - 4;  // 1 whole step below
-        handleTurnMeterBetween(EmbRet, pi, upper, pi, lower, pi,  durPi, meter);
-    } else if (variant == "BNFBTurnSF") {  // Between principal notes,front and back of turn, the front is 1 whole step above, the back is 1/2 step below
-        int upper = pi + 3;  // 1 whole step above
-        int lower = pi - 3;  // 1/2 step below
-        handleTurnMeterBetween(EmbRet, pi, upper, pi, lower, pi,  durPi, meter);
+    {VariantId::BNT, "BNT", "Between notes - regular turn", PatternFamily::Between, 2, -1, 0},  // Turn between principal notes, regular
+    {VariantId::BNFTurnF, "BNFTurnF", "Between notes - half step above/below", PatternFamily::Between, 1, -1, 0},  // Turn between Notes 1/2 step above, the principal note, and the lower auxiliary (1/2 step below) are played, resolve and hold for duration
+    {VariantId::BNFTurnS, "BNFTurnS", "Between notes - whole step above/below", PatternFamily::Between, 2, -2, 0},  // Turn between Notes 1 whole step above, the principal note, and the lower auxiliary (1 whole step below) are played, resolve and hold for duration
+    {VariantId::BNBTurn, "BNBTurn", "Between notes - whole step variant", PatternFamily::Between, 1, -2, 0},  // Between principal notes, 1 whole step above, the principal note, and the lower auxiliary (1 whole step below) are played, resolve and hold for duration
+    {VariantId::BNBTurnS, "BNBTurnS", "Between notes - whole step variant 2", PatternFamily::Between, 1, -3, 0},  // Between principal notes, whole step above, the principal note, and the lower auxiliary (1 whole below) are played, resolve and hold for duration
+    {VariantId::BNFBTurnF, "BNFBTurnF", "Between notes - front/back half step", PatternFamily::Between, 3, -1, 0},  // Between principal notes,1/2 step above, the principle note, and the lower turn is 1/2 step below the principal
+    {VariantId::BNFBTurnS, "BNFBTurnS", "Between notes - front/back whole step", PatternFamily::Between, 3, -2, 0},  // Between principal notes, 1/2 step above, the principle note, and the lower turn is 1 whole step below the principal
+    {VariantId::BNFBTurnFF, "BNFBTurnFF", "Between notes - front/back half steps", PatternFamily::Between, 2, -3, 0},  // Between principal notes,front and back of turn - both pre and post principal note are 1/2 step above and below
+    {VariantId::BNFBTurnSS, "BNFBTurnSS", "Between notes - front/back whole steps", PatternFamily::Between, 4, -2, 0},  // Between principal notes, front and back of turn - both pre and post principal note are 1 whole step above and below
+    {VariantId::BNFBTurnFS, "BNFBTurnFS", "Between notes - front half, back whole", PatternFamily::Between, 2, -4, 0},  // Between principal notes,front and back of turn, the front is 1/2 step above, the back is 1 whole step below
+    {VariantId::BNFBTurnSF, "BNFBTurnSF", "Between notes - front whole, back half", PatternFamily::Between, 3, -3, 0},  // Between principal notes,front and back of turn, the front is 1 whole step above, the back is 1/2 step below
 
     // Trilled Turn variants
-    } else if (variant == "TT") {  // Trilled regular turn
-        int upper = pi + 2;  // whole step above
-        int lower = pi - 1;  // 1/2 step below
-        handleTurnMeterTrille(EmbRet, upper, pi, lower, durPi, meter);
-    } else if (variant == "TFTurnF") {  // Trilled 1/2 step above, the principal note, and the lower auxiliary (1 whole step below) are played, resolve and hold for duration
-        int upper = pi + 1;  // 1/2 step above
-        int lower = pi - 2;  // 1 whole step below
-        handleTurnMeterTrille(EmbRet, upper, pi, lower, durPi, meter);
-    } else if (variant == "TFTurnS") {  // Trilled 1 whole step above, the principal note, and the lower auxiliary (1 whole step below) are played, resolve and hold for duration
-        int upper = pi + 2;  // 1 whole step above
-        int lower = pi - 2;  // 1 whole step below
-        handleTurnMeterTrille(EmbRet, upper, pi, lower, durPi, meter);
-    } else if (variant == "TBTurnF") {  // Trilled whole step above, the principal note, and the lower auxiliary (1/2 step below) are played, resolve and hold for duration
-        int upper = pi + 2;  // whole step above
-        int lower = pi - 1;  // 1/2 step below
-        handleTurnMeterTrille(EmbRet, upper, pi, lower, durPi, meter);
-    } else if (variant == "TBTurnS") {  // Trilled whole step above, the principal note, and the lower auxiliary (1 whole below) are played, resolve and hold for duration
-        int upper = pi + 2;  // whole step above
-        int lower = pi - 2;  // 1 whole step below
-        handleTurnMeterTrille(EmbRet, upper, pi, lower, durPi, meter);
-    } else if (variant == "TFBTurnF") {  // Trilled 1/2 step above, the principle note, and the lower turn is 1/2 step below the principal
-        int upper = pi + 1;  // 1/2 step above
-        int lower = pi - 1;  // 1/2 step below
-        handleTurnMeterTrille(EmbRet, upper, pi, lower, durPi, meter);
-    } else if (variant == "TFBTurnS") {  // Trilled 1/2 step above, the principle note, and the lower turn is 1 whole step below the principal
-        int upper = pi + 1;  // 1/2 step above
-        int lower = pi - 2;  // 1 whole step below
-        handleTurnMeterTrille(EmbRet, upper, pi, lower, durPi, meter);
-    } else if (variant == "TFBTurnFF") {  // Trilled front and back of turn - both pre and post principal note are 1/2 step above and below
-        int upper = pi + 1;  // 1/2 step above
-        int lower = pi - 1;  // 1/2 step below
-        handleTurnMeterTrille(EmbRet, upper, pi, lower, durPi, meter);
-    } else if (variant == "TFBTurnSS") {  // Trilled front and back of turn - both pre and post principal note are 1 whole step above and below
-        int upper = pi + 2;  // 1 whole step above
-        int lower = pi - 2;  // 1 whole step below
-        handleTurnMeterTrille(EmbRet, upper, pi, lower, durPi, meter);
-    } else if (variant == "TFBTurnFS") {  // Trilled front and back of turn, the front is 1/2 step above, the back is 1 whole step below
-        int upper = pi + 1;  // 1/2 step above
-        int lower = pi - 2;  // 1 whole step below
-        handleTurnMeterTrille(EmbRet, upper, pi, lower, durPi, meter);
-    } else if (variant == "TFBTurnSF") {  // Trilled front and back of turn, the front is 1 whole step above, the back is 1/2 step below
-        int upper = pi + 2;  // 1 whole step above
-        int lower = pi - 1;  // 1/2 step below
-        handleTurnMeterTrille(EmbRet, upper, pi, lower, durPi, meter);
+    {VariantId::TT, "TT", "Trilled regular turn", PatternFamily::Trille, 2, -1, 0},  // Trilled regular turn
+    {VariantId::TFTurnF, "TFTurnF", "Trilled half step above, whole step below", PatternFamily::Trille, 1, -2, 0},  // Trilled 1/2 step above, the principal note, and the lower auxiliary (1 whole step below) are played, resolve and hold for duration
+    {VariantId::TFTurnS, "TFTurnS", "Trilled whole step above/below", PatternFamily::Trille, 2, -2, 0},  // Trilled 1 whole step above, the principal note, and the lower auxiliary (1 whole step below) are played, resolve and hold for duration
+    {VariantId::TBTurnF, "TBTurnF", "Trilled whole step above, half step below", PatternFamily::Trille, 2, -1, 0},  // Trilled whole step above, the principal note, and the lower auxiliary (1/2 step below) are played, resolve and hold for duration
+    {VariantId::TBTurnS, "TBTurnS", "Trilled whole step above/below", PatternFamily::Trille, 2, -2, 0},  // Trilled whole step above, the principal note, and the lower auxiliary (1 whole below) are played, resolve and hold for duration
+    {VariantId::TFBTurnF, "TFBTurnF", "Trilled front/back half step", PatternFamily::Trille, 1, -1, 0},  // Trilled 1/2 step above, the principle note, and the lower turn is 1/2 step below the principal
+    {VariantId::TFBTurnS, "TFBTurnS", "Trilled front/back whole step", PatternFamily::Trille, 1, -2, 0},  // Trilled 1/2 step above, the principle note, and the lower turn is 1 whole step below the principal
+    {VariantId::TFBTurnFF, "TFBTurnFF", "Trilled front/back half steps", PatternFamily::Trille, 1, -1, 0},  // Trilled front and back of turn - both pre and post principal note are 1/2 step above and below
+    {VariantId::TFBTurnSS, "TFBTurnSS", "Trilled front/back whole steps", PatternFamily::Trille, 2, -2, 0},  // Trilled front and back of turn - both pre and post principal note are 1 whole step above and below
+    {VariantId::TFBTurnFS, "TFBTurnFS", "Trilled front half, back whole", PatternFamily::Trille, 1, -2, 0},  // Trilled front and back of turn, the front is 1/2 step above, the back is 1 whole step below
+    {VariantId::TFBTurnSF, "TFBTurnSF", "Trilled front whole, back half", PatternFamily::Trille, 2, -1, 0},  // Trilled front and back of turn, the front is 1 whole step above, the back is 1/2 step below
 
     // P32 Turn variants
-    } else if (variant == "P32T") {  // P32 Turn regular turn
-        int upper = pi + 2;  // whole step above
-        int lower = pi - 1;  // 1/2 step below
-        handleTurnMeterP32(EmbRet, upper, pi, lower, durPi, meter);
-    } else if (variant == "P32FTurnF") {  // P32 Turn 1/2 step above, the principal note, and the lower auxiliary (1 whole step below) are played, resolve and hold for duration
-        int upper = pi + 1;  // 1/2 step above
-        int lower = pi - 2;  // 1 whole step below
-        handleTurnMeterP32(EmbRet, upper, pi, lower, durPi, meter);
-    } else if (variant == "P32FTurnS") {  // P32 Turn 1 whole step above, the principal note, and the lower auxiliary (1 whole step below) are played, resolve and hold for duration
-        int upper = pi + 2;  // 1 whole step above
-        int lower = pi - 2;  // 1 whole step below
-        handleTurnMeterP32(EmbRet, upper, pi, lower, durPi, meter);
-    } else if (variant == "P32BTurnF") {  // P32 Turn whole step above, the principal note, and the lower auxiliary (1/2 step below) are played, resolve and hold for duration
-        int upper = pi + 2;  // whole step above
-        int lower = pi - 1;  // 1/2 step below
-        handleTurnMeterP32(EmbRet, upper, pi, lower, durPi, meter);
-    } else if (variant == "P32BTurnS") {  // P32 Turn whole step above, the principal note, and the lower auxiliary (1 whole below) are played, resolve and hold for duration
-        int upper = pi + 2;  // whole step above
-        int lower = pi - 2;  // 1 whole step below
-        handleTurnMeterP32(EmbRet, upper, pi, lower, durPi, meter);
-    } else if (variant == "P32FBTurnF") {  // P32 Turn 1/2 step above, the principle note, and the lower turn is 1/2 step below the principal
-        int upper = pi + 1;  // 1/2 step above
-        int lower = pi - 1;  // 1/2 step below
-        handleTurnMeterP32(EmbRet, upper, pi, lower, durPi, meter);
-    } else if (variant == "P32FBTurnS") {  // P32 Turn 1/2 step above, the principle note, and the lower turn is 1 whole step below the principal
-        int upper = pi + 1;  // 1/2 step above
-        int lower = pi - 2;  // 1 whole step below
-        handleTurnMeterP32(EmbRet, upper, pi, lower, durPi, meter);
-    } else if (variant == "P32FBTurnFF") {  // P32 Turn front and back of turn - both pre and post principal note are 1/2 step above and below
-        int upper = pi + 1;  // 1/2 step above
-        int lower = pi - 1;  // 1/2 step below
-        handleTurnMeterP32(EmbRet, upper, pi, lower, durPi, meter);
-    } else if (variant == "P32FBTurnSS") {  // P32 Turn front and back of turn - both pre and post principal note are 1 whole step above and below
-        int upper = pi + 2;  // 1 whole step above
-        int lower = pi - 2;  // 1 whole step below
-        handleTurnMeterP32(EmbRet, upper, pi, lower, durPi, meter);
-    } else if (variant == "P32FBTurnFS") {  // P32 Turn front and back of turn, the front is 1/2 step above, the back is 1 whole step below
-        int upper = pi + 1;  // 1/2 step above
-        int lower = pi - 2;  // 1 whole step below
-        handleTurnMeterP32(EmbRet, upper, pi, lower, durPi, meter);
-    } else if (variant == "P32FBTurnSF") {  // P32 Turn front and back of turn, the front is 1 whole step above, the back is 1/2 step below
-        int upper = pi + 2;  // 1 whole step above
-        int lower = pi - 1;  // 1/2 step below
-        handleTurnMeterP32(EmbRet, upper, pi, lower, durPi, meter);
+    {VariantId::P32T, "P32T", "P32 regular turn", PatternFamily::P32, 2, -1, 0},  // P32 Turn regular turn
+    {VariantId::P32FTurnF, "P32FTurnF", "P32 half step above, whole step below", PatternFamily::P32, 1, -2, 0},  // P32 Turn 1/2 step above, the principal note, and the lower auxiliary (1 whole step below) are played, resolve and hold for duration
+    {VariantId::P32FTurnS, "P32FTurnS", "P32 whole step above/below", PatternFamily::P32, 2, -2, 0},  // P32 Turn 1 whole step above, the principal note, and the lower auxiliary (1 whole step below) are played, resolve and hold for duration
+    {VariantId::P32BTurnF, "P32BTurnF", "P32 whole step above, half step below", PatternFamily::P32, 2, -1, 0},  // P32 Turn whole step above, the principal note, and the lower auxiliary (1/2 step below) are played, resolve and hold for duration
+    {VariantId::P32BTurnS, "P32BTurnS", "P32 whole step above/below", PatternFamily::P32, 2, -2, 0},  // P32 Turn whole step above, the principal note, and the lower auxiliary (1 whole below) are played, resolve and hold for duration
+    {VariantId::P32FBTurnF, "P32FBTurnF", "P32 front/back half step", PatternFamily::P32, 1, -1, 0},  // P32 Turn 1/2 step above, the principle note, and the lower turn is 1/2 step below the principal
+    {VariantId::P32FBTurnS, "P32FBTurnS", "P32 front/back whole step", PatternFamily::P32, 1, -2, 0},  // P32 Turn 1/2 step above, the principle note, and the lower turn is 1 whole step below the principal
+    {VariantId::P32FBTurnFF, "P32FBTurnFF", "P32 front/back half steps", PatternFamily::P32, 1, -1, 0},  // P32 Turn front and back of turn - both pre and post principal note are 1/2 step above and below
+    {VariantId::P32FBTurnSS, "P32FBTurnSS", "P32 front/back whole steps", PatternFamily::P32, 2, -2, 0},  // P32 Turn front and back of turn - both pre and post principal note are 1 whole step above and below
+    {VariantId::P32FBTurnFS, "P32FBTurnFS", "P32 front half, back whole", PatternFamily::P32, 1, -2, 0},  // P32 Turn front and back of turn, the front is 1/2 step above, the back is 1 whole step below
+    {VariantId::P32FBTurnSF, "P32FBTurnSF", "P32 front whole, back half", PatternFamily::P32, 2, -1, 0},  // P32 Turn front and back of turn, the front is 1 whole step above, the back is 1/2 step below
 
     // Snapped Turn variants
-    } else if (variant == "ST") {  // Snapped turn regular turn
-        int upper = pi + 2;  // whole step above
-        int lower = pi - 1;  // 1/2 step below
-        handleTurnMeterSnapped(EmbRet, upper, pi, lower, durPi, meter);
-    } else if (variant == "SFTurnF") {  // Snapped turn 1/2 step above, the principal note, and the lower auxiliary (1 whole step below) are played, resolve and hold for duration
-        int upper = pi + 1;  // 1/2 step above
-        int lower = pi - 2;  // 1 whole step below
-        handleTurnMeterSnapped(EmbRet, upper, pi, lower, durPi, meter);
-    } else if (variant == "SFTurnS") {  // Snapped turn Turn 1 whole step above, the principal note, and the lower auxiliary (1 whole step below) are played, resolve and hold for duration
-        int upper = pi + 2;  // 1 whole step above
-        int lower = pi - 2;  // 1 whole step below
-        handleTurnMeterSnapped(EmbRet, upper, pi, lower, durPi, meter);
-    } else if (variant == "SBTurnF") {  // Snapped turn whole step above, the principal note, and the lower auxiliary (1/2 step below) are played, resolve and hold for duration
-        int upper = pi + 2;  // whole step above
-        int lower = pi - 1;  // 1/2 step below
-        handleTurnMeterSnapped(EmbRet, upper, pi, lower, durPi, meter);
-    } else if (variant == "SBTurnS") {  // Snapped turn Turn whole step above, the principal note, and the lower auxiliary (1 whole below) are played, resolve and hold for duration
-        int upper = pi + 2;  // whole step above
-        int lower = pi - 2;  // 1 whole step below
-        handleTurnMeterSnapped(EmbRet, upper, pi, lower, durPi, meter);
-    } else if (variant == "SFBTurnF") {  // Snapped turn 1/2 step above, the principle note, and the lower turn is 1/2 step below the principal
-        int upper = pi + 1;  // 1/2 step above
-        int lower = pi - 1;  // 1/2 step below
-        handleTurnMeterSnapped(EmbRet, upper, pi, lower, durPi, meter);
-    } else if (variant == "SFBTurnS") {  // Snapped turn 1/2 step above, the principle note, and the lower turn is 1 whole step below the principal
-        int upper = pi + 1;  // 1/2 step above
-        int lower = pi - 2;  // 1 whole step below
-        handleTurnMeterSnapped(EmbRet, upper, pi, lower, durPi, meter);
-    } else if (variant == "SFBTurnFF") {  // Snapped turn front and back of turn - both pre and post principal note are 1/2 step above and below
-        int upper = pi + 1;  // 1/2 step above
-        int lower = pi - 1;  // 1/2 step below
-        handleTurnMeterSnapped(EmbRet, upper, pi, lower, durPi, meter);
-    } else if (variant == "SFBTurnSS") {  // Snapped turn front and back of turn - both pre and post principal note are 1 whole step above and below
-        int upper = pi + 2;  // 1 whole step above
-        int lower = pi - 2;  // 1 whole step below
-        handleTurnMeterSnapped(EmbRet, upper, pi, lower, durPi, meter);
-    } else if (variant == "SFBTurnFS") {  // Snapped turn front and back of turn, the front is 1/2 step above, the back is 1 whole step below
-        int upper = pi + 1;  // 1/2 step above
-        int lower = pi - 2;  // 1 whole step below
-        handleTurnMeterSnapped(EmbRet, upper, pi, lower, durPi, meter);
-    } else if (variant == "SFBTurnSF") {  // Snapped turn front and back of turn, the front is 1 whole step above, the back is 1/2 step below
-        int upper = pi + 2;  // 1 whole step above
-        int lower = pi - 1;  // 1/2 step below
-        handleTurnMeterSnapped(EmbRet, upper, pi, lower, durPi, meter);
-    } else {
-        // Handle unknown variant
-        throw std::invalid_argument("Unknown turn variant: " + variant);
-    }
+    {VariantId::ST, "ST", "Snapped regular turn", PatternFamily::Snapped, 2, -1, 0},  // Snapped turn regular turn
+    {VariantId::SFTurnF, "SFTurnF", "Snapped half step above, whole step below", PatternFamily::Snapped, 1, -2, 0},  // Snapped turn 1/2 step above, the principal note, and the lower auxiliary (1 whole step below) are played, resolve and hold for duration
+    {VariantId::SFTurnS, "SFTurnS", "Snapped whole step above/below", PatternFamily::Snapped, 2, -2, 0},  // Snapped turn Turn 1 whole step above, the principal note, and the lower auxiliary (1 whole step below) are played, resolve and hold for duration
+    {VariantId::SBTurnF, "SBTurnF", "Snapped whole step above, half step below", PatternFamily::Snapped, 2, -1, 0},  // Snapped turn whole step above, the principal note, and the lower auxiliary (1/2 step below) are played, resolve and hold for duration
+    {VariantId::SBTurnS, "SBTurnS", "Snapped whole step above/below", PatternFamily::Snapped, 2, -2, 0},  // Snapped turn Turn whole step above, the principal note, and the lower auxiliary (1 whole below) are played, resolve and hold for duration
+    {VariantId::SFBTurnF, "SFBTurnF", "Snapped front/back half step", PatternFamily::Snapped, 1, -1, 0},  // Snapped turn 1/2 step above, the principle note, and the lower turn is 1/2 step below the principal
+    {VariantId::SFBTurnS, "SFBTurnS", "Snapped front/back whole step", PatternFamily::Snapped, 1, -2, 0},  // Snapped turn 1/2 step above, the principle note, and the lower turn is 1 whole step below the principal
+    {VariantId::SFBTurnFF, "SFBTurnFF", "Snapped front/back half steps", PatternFamily::Snapped, 1, -1, 0},  // Snapped turn front and back of turn - both pre and post principal note are 1/2 step above and below
+    {VariantId::SFBTurnSS, "SFBTurnSS", "Snapped front/back whole steps", PatternFamily::Snapped, 2, -2, 0},  // Snapped turn front and back of turn - both pre and post principal note are 1 whole step above and below
+    {VariantId::SFBTurnFS, "SFBTurnFS", "Snapped front half, back whole", PatternFamily::Snapped, 1, -2, 0},  // Snapped turn front and back of turn, the front is 1/2 step above, the back is 1 whole step below
+    {VariantId::SFBTurnSF, "SFBTurnSF", "Snapped front whole, back half", PatternFamily::Snapped, 2, -1, 0},  // Snapped turn front and back of turn, the front is 1 whole step above, the back is 1/2 step below
+};
 
-    return EmbRet;
+static_assert(sizeof(TURN_VARIANT_TABLE) / sizeof(TURN_VARIANT_TABLE[0]) == VARIANT_COUNT,
+              "TURN_VARIANT_TABLE must have one entry per VariantId");
+
+// Verify at compile time that each table entry sits at the index of its VariantId
+constexpr bool variantTableIsOrdered() {
+    for (int i = 0; i < VARIANT_COUNT; ++i) {
+        if (static_cast<int>(TURN_VARIANT_TABLE[i].id) != i) {
+            return false;
+        }
+    }
+    return true;
 }
+static_assert(variantTableIsOrdered(), "TURN_VARIANT_TABLE entries must be ordered by VariantId");
 
-// Structure to represent a turn variant
-struct TurnVariant {
-    std::string name;
-    std::string description;
-};
-
-// Generate a random pool of turn variants for user selection
-std::vector<TurnVariant> generateRandomTurnVariantPool(int poolSize = 10) {
-    // Define the complete pool of turn variants
-    const std::vector<TurnVariant> allVariants = {
-        // Basic Turn variants
-        {"Turn", "Whole step above, principal note, half step below"},
-        {"FTurnF", "Half step above, principal note, whole step below"},
-        {"FTurnS", "Whole step above, principal note, whole step below"},
-        {"BTurnF", "Whole step above, principal note, half step below"},
-        {"BTurnS", "Whole step above, principal note, whole step below"},
-
-        // Front and Back Turn variants
-        {"FBTurnF", "Half step above, principal, half step below"},
-        {"FBTurnS", "Half step above, principal, whole step below"},
-        {"FBTurnFF", "Front/back - half step above/below"},
-        {"FBTurnSS", "Front/back - whole step above/below"},
-        {"FBTurnFS", "Front half step, back whole step"},
-        {"FBTurnSF", "Front whole step, back half step"},
-
-        // Between Notes Turn variants
-        {"BNT", "Between notes - regular turn"},
-        {"BNFTurnF", "Between notes - half step above/below"},
-        {"BNFTurnS", "Between notes - whole step above/below"},
-        {"BNBTurn", "Between notes - whole step variant"},
-        {"BNBTurnS", "Between notes - whole step variant 2"},
-        {"BNFBTurnF", "Between notes - front/back half step"},
-        {"BNFBTurnS", "Between notes - front/back whole step"},
-        {"BNFBTurnFF", "Between notes - front/back half steps"},
-        {"BNFBTurnSS", "Between notes - front/back whole steps"},
-        {"BNFBTurnFS", "Between notes - front half, back whole"},
-        {"BNFBTurnSF", "Between notes - front whole, back half"},
-
-        // Trilled Turn variants
-        {"TT", "Trilled regular turn"},
-        {"TFTurnF", "Trilled half step above, whole step below"},
-        {"TFTurnS", "Trilled whole step above/below"},
-        {"TBTurnF", "Trilled whole step above, half step below"},
-        {"TBTurnS", "Trilled whole step above/below"},
-        {"TFBTurnF", "Trilled front/back half step"},
-        {"TFBTurnS", "Trilled front/back whole step"},
-        {"TFBTurnFF", "Trilled front/back half steps"},
-        {"TFBTurnSS", "Trilled front/back whole steps"},
-        {"TFBTurnFS", "Trilled front half, back whole"},
-        {"TFBTurnSF", "Trilled front whole, back half"},
-
-        // P32 Turn variants
-        {"P32T", "P32 regular turn"},
-        {"P32FTurnF", "P32 half step above, whole step below"},
-        {"P32FTurnS", "P32 whole step above/below"},
-        {"P32BTurnF", "P32 whole step above, half step below"},
-        {"P32BTurnS", "P32 whole step above/below"},
-        {"P32FBTurnF", "P32 front/back half step"},
-        {"P32FBTurnS", "P32 front/back whole step"},
-        {"P32FBTurnFF", "P32 front/back half steps"},
-        {"P32FBTurnSS", "P32 front/back whole steps"},
-        {"P32FBTurnFS", "P32 front half, back whole"},
-        {"P32FBTurnSF", "P32 front whole, back half"},
-
-        // Snapped Turn variants
-        {"ST", "Snapped regular turn"},
-        {"SFTurnF", "Snapped half step above, whole step below"},
-        {"SFTurnS", "Snapped whole step above/below"},
-        {"SBTurnF", "Snapped whole step above, half step below"},
-        {"SBTurnS", "Snapped whole step above/below"},
-        {"SFBTurnF", "Snapped front/back half step"},
-        {"SFBTurnS", "Snapped front/back whole step"},
-        {"SFBTurnFF", "Snapped front/back half steps"},
-        {"SFBTurnSS", "Snapped front/back whole steps"},
-        {"SFBTurnFS", "Snapped front half, back whole"},
-        {"SFBTurnSF", "Snapped front whole, back half"}
-    };
+// Look up a variant by name, returns VariantId::Count if the name is unknown
+VariantId findVariantId(std::string_view name) {
+    for (const VariantSpec& spec : TURN_VARIANT_TABLE) {
+        if (spec.name == name) {
+            return spec.id;
+        }
+    }
+    return VariantId::Count;
+}
 
-    // Create a copy of all variants and shuffle it
-    std::vector<TurnVariant> shuffledVariants = allVariants;
+// Name of a variant as used in output files
+std::string_view variantName(VariantId id) {
+    return TURN_VARIANT_TABLE[static_cast<int>(id)].name;
+}
 
-    // Use modern random number generation
-    std::random_device rd;
-    std::mt19937 g(rd());
-    std::shuffle(shuffledVariants.begin(), shuffledVariants.end(), g);
+// Reason why a turn cannot be applied, or nullptr if the arguments are valid
+const char* turnArgumentError(int durPi, TimeMeter meter) {
+    if (durPi <= 0) {
+        return "Duration (durPi) must be greater than 0";
+    }
+    if (meter != DUPLE && meter != TRIPLE) {
+        return "Invalid TimeMeter";
+    }
+    return nullptr;
+}
 
-    // Return the first poolSize variants
-    std::vector<TurnVariant> pool;
-    for (int i = 0; i < std::min(poolSize, static_cast<int>(shuffledVariants.size())); ++i) {
-        pool.push_back(shuffledVariants[i]);
+// Shared argument checks for applyTurnVariants
+void validateTurnArguments(int durPi, TimeMeter meter) {
+    if (const char* error = turnArgumentError(durPi, meter)) {
+        throw std::invalid_argument(error);
     }
+}
 
-    return pool;
+// Expand one pattern family with explicit auxiliary pitches
+template <typename Output>
+constexpr void expandPatternFamily(Output& EmbRet, PatternFamily family, int pi, int upper, int lower, int underLower,
+                                   int durPi, TimeMeter meter) {
+    switch (family) {
+        case PatternFamily::Meter:
+            handleTurnMeter(EmbRet, upper, pi, lower, pi, durPi, meter);
+            break;
+        case PatternFamily::FB:
+            handleTurnMeterFB(EmbRet, upper, pi, lower, underLower, lower, pi, durPi, meter);
+            break;
+        case PatternFamily::Between:
+            handleTurnMeterBetween(EmbRet, pi, upper, pi, lower, pi, durPi, meter);
+            break;
+        case PatternFamily::Trille:
+            handleTurnMeterTrille(EmbRet, upper, pi, lower, durPi, meter);
+            break;
+        case PatternFamily::P32:
+            handleTurnMeterP32(EmbRet, upper, pi, lower, durPi, meter);
+            break;
+        case PatternFamily::Snapped:
+            handleTurnMeterSnapped(EmbRet, upper, pi, lower, durPi, meter);
+            break;
+    }
 }
 
-// Parse user input for multiple choice selection
-std::vector<int> parseUserChoices(const std::string& input, int maxChoice) {
-    std::vector<int> choices;
-    std::istringstream iss(input);
-    std::string token;
+// Expand a validated variant into any output accepted by the handleTurnMeter* helpers
+template <typename Output>
+void expandTurnFamily(Output& EmbRet, int pi, int durPi, TimeMeter meter, VariantId variant) {
+    const VariantSpec& spec = TURN_VARIANT_TABLE[static_cast<int>(variant)];
+    expandPatternFamily(EmbRet, spec.family, pi, pi + spec.upperOffset, pi + spec.lowerOffset,
+                        pi + spec.underLowerOffset, durPi, meter);
+}
 
-    while (iss >> token) {
-        try {
-            int choice = std::stoi(token);
-            if (choice >= 1 && choice <= maxChoice) {
-                // Avoid duplicates
-                if (std::find(choices.begin(), choices.end(), choice) == choices.end()) {
-                    choices.push_back(choice);
-                }
-            }
-        } catch (const std::exception&) {
-            // Ignore invalid tokens
-        }
+// Apply a turn variant by id into caller-provided storage (no heap allocation)
+void expandTurnVariant(int pi, int durPi, TimeMeter meter, VariantId variant, TurnExpansion& out) {
+    validateTurnArguments(durPi, meter);
+    if (variant >= VariantId::Count) {
+        throw std::invalid_argument("Unknown turn variant id");
     }
 
-    return choices;
+    out.clear();
+    expandTurnFamily(out, pi, durPi, meter, variant);
 }
 
-// Check if a label should be transformed based on percentage
-bool shouldTransformLabel(double transformationPercentage) {
-    // Generate random number between 0 and 100
-    double randomValue = (static_cast<double>(rand()) / RAND_MAX) * 100.0;
-    return randomValue < transformationPercentage;
-}
+// Apply a turn variant by id - a single table lookup and family dispatch
+std::vector<std::pair<int, int>> applyTurnVariants(int pi, int durPi, TimeMeter meter, VariantId variant) {
+    validateTurnArguments(durPi, meter);
+    if (variant >= VariantId::Count) {
+        throw std::invalid_argument("Unknown turn variant id");
+    }
 
-// Structure to represent a MIDI note event
-struct MidiEvent {
-    int track;
-    int noteNumber;
-    int startTime;
-    int duration;
-    bool isNoteOn;
-};
-
-// Application state
-struct AppState {
-    std::string inputFile;
-    std::string outputFile;
-    std::string midiOutputFile;
-    double transformationPercentage = 50.0;
-    std::vector<std::string> selectedVariants;
-    bool processingComplete = false;
-    std::string statusMessage;
-    std::string resultSummary;
-    int totalEligibleNotes = 0;
-    int transformedNotes = 0;
-    std::map<std::string, int> variantUsageCount;
-};
+    std::vector<std::pair<int, int>> EmbRet;
+    EmbRet.reserve(MAX_TURN_SEGMENTS);
+    expandTurnFamily(EmbRet, pi, durPi, meter, variant);
+    return EmbRet;
+}
 
-// Function to process file with GUI integration
-void processFile(const std::string& inputFile, const std::string& outputFile, AppState& state) {
-    std::ifstream input(inputFile);
-    std::ofstream output(outputFile);
+// Main function to apply turn variants
+std::vector<std::pair<int, int>> applyTurnVariants(int pi, int durPi, TimeMeter meter, const std::string& variant) {
+    validateTurnArguments(durPi, meter);
 
-    if (!input.is_open() || !output.is_open()) {
-        state.statusMessage = "Error opening files.";
-        return;
+    VariantId id = findVariantId(variant);
+    if (id == VariantId::Count) {
+        // Handle unknown variant
+        throw std::invalid_argument("Unknown turn variant: " + variant);
     }
 
-    // Write header to the output file
-    output << std::left << std::setw(11) << "Track"
-           << std::setw(11) << "Note"
-           << std::setw(20) << "Duration"
-           << std::setw(20) << "Label"
-           << std::setw(25) << "Turn_Variant"
-           << "\n";
-    output << "---------------------------------------------------------------------------------\n";
+    return applyTurnVariants(pi, durPi, meter, id);
+}
 
-    // Reset statistics
-    state.totalEligibleNotes = 0;
-    state.transformedNotes = 0;
-    state.variantUsageCount.clear();
+// Writes segments through a raw cursor, used to fill TurnBatch storage in place
+struct SegmentWriter {
+    Segment* cursor;
 
-    std::string line;
-    while (std::getline(input, line)) {
-        std::istringstream ss(line);
+    void push_back(const Segment& segment) { *cursor++ = segment; }
+};
 
-        int track, duration;
-        std::string noteName, label;
+// Number of PatternFamily values
+constexpr int PATTERN_FAMILY_COUNT = 6;
 
-        // Parse line with Note in string format (e.g., "C4")
-        if (!(ss >> track >> noteName >> duration)) {
-            output << line << "\n";  // Handle malformed lines
-            continue;
-        }
+// Number of (pattern family, meter) combinations, each with its own segment layout
+constexpr int SEGMENT_LAYOUT_COUNT = PATTERN_FAMILY_COUNT * 2;
 
-        std::getline(ss, label);
-        label.erase(0, label.find_first_not_of(" \t"));  // Trim leading whitespace
-        // Remove trailing carriage return and whitespace (Windows line endings)
-        label.erase(label.find_last_not_of(" \t\r\n") + 1);
+// Which note a segment of a layout plays
+enum PitchRole {
+    ROLE_PRINCIPAL,
+    ROLE_UPPER,
+    ROLE_LOWER,
+    ROLE_UNDER_LOWER
+};
 
-        // Check if this label is eligible for transformation
-        if (label == "I8" || label == "U2R" || label == "SPD" || label == "CH" ||
-            label == "CW" || label == "CD" || label == "HT" || label == "FM" ||
-            label == "SLP" || label == "RN" || label == "LAD" || label == "DNW" || label == "SAN"||
-            label == "RTR2" || label == "TNTDN"||label == "SMP" || label == "LP"||
-            label == "DHT" || label == "LNR"||label == "TNTLN" || label == "TNTTN"||label == "RTD2") {
+// Duration used to probe the handleTurnMeter* helpers, divisible by every segment divisor
+constexpr int LAYOUT_PROBE_DURATION = 840;
+
+// Shape of one pattern family's expansion in one meter. Every segment except the
+// last lasts durPi * numerator / denominator (rounded down), the last one gets the
+// remaining duration. multiplier/shift implement the division without a divide:
+// a plain right shift when multiplier is 0, otherwise (x * multiplier) >> shift.
+// Like the helpers, this assumes durPi * numerator does not overflow an int.
+struct SegmentLayout {
+    int count = 0;
+    int roles[MAX_TURN_SEGMENTS] = {};
+    int numerators[MAX_TURN_SEGMENTS] = {};
+    int denominators[MAX_TURN_SEGMENTS] = {};
+    std::uint32_t multipliers[MAX_TURN_SEGMENTS] = {};
+    int shifts[MAX_TURN_SEGMENTS] = {};
+};
 
-            state.totalEligibleNotes++;
+constexpr int greatestCommonDivisor(int a, int b) {
+    while (b != 0) {
+        int remainder = a % b;
+        a = b;
+        b = remainder;
+    }
+    return a;
+}
 
-            // Check if this note should be transformed based on percentage
-            if (shouldTransformLabel(state.transformationPercentage)) {
-                state.transformedNotes++;
+// Derive a layout by running the family's helper at compile time with role numbers as pitches
+constexpr SegmentLayout deriveSegmentLayout(PatternFamily family, TimeMeter meter) {
+    TurnExpansion probe;
+    expandPatternFamily(probe, family, ROLE_PRINCIPAL, ROLE_UPPER, ROLE_LOWER, ROLE_UNDER_LOWER,
+                        LAYOUT_PROBE_DURATION, meter);
+
+    SegmentLayout layout;
+    layout.count = probe.count;
+    for (int k = 0; k < probe.count; ++k) {
+        int divisor = greatestCommonDivisor(probe.segments[k].duration, LAYOUT_PROBE_DURATION);
+        int denominator = LAYOUT_PROBE_DURATION / divisor;
+        layout.roles[k] = probe.segments[k].pitch;
+        layout.numerators[k] = probe.segments[k].duration / divisor;
+        layout.denominators[k] = denominator;
+
+        int log2 = 0;
+        while ((2 << log2) <= denominator) {
+            ++log2;
+        }
+        if ((denominator & (denominator - 1)) == 0) {
+            layout.shifts[k] = log2;
+        } else {
+            // Round-up reciprocal, exact for every non-negative 31-bit dividend
+            std::uint64_t scale = std::uint64_t{1} << (32 + log2);
+            layout.multipliers[k] = static_cast<std::uint32_t>((scale + denominator - 1) / denominator);
+            layout.shifts[k] = 32 + log2;
+        }
+    }
+    return layout;
+}
 
-                try {
-                    // Convert note name to MIDI number
-                    int noteIndex = getNoteNumber(noteName);
+constexpr int segmentLayoutIndex(PatternFamily family, TimeMeter meter) {
+    return static_cast<int>(family) * 2 + static_cast<int>(meter);
+}
 
-                    // Randomly select a variant from the user's choices
-                    std::string selectedVariant;
-                    if (state.selectedVariants.empty() || (state.selectedVariants.size() == 1 && state.selectedVariants[0] == "RANDOM")) {
-                        // Use a random variant from the complete list
-                        std::vector<TurnVariant> allVariants = generateRandomTurnVariantPool(100); // Get a large pool
-                        selectedVariant = allVariants[rand() % allVariants.size()].name;
-                    } else {
-                        // Use one of the user's selected variants randomly
-                        selectedVariant = state.selectedVariants[rand() % state.selectedVariants.size()];
-                    }
+constexpr std::array<SegmentLayout, SEGMENT_LAYOUT_COUNT> buildSegmentLayouts() {
+    std::array<SegmentLayout, SEGMENT_LAYOUT_COUNT> layouts{};
+    for (int family = 0; family < PATTERN_FAMILY_COUNT; ++family) {
+        for (TimeMeter meter : {DUPLE, TRIPLE}) {
+            layouts[segmentLayoutIndex(static_cast<PatternFamily>(family), meter)] =
+                deriveSegmentLayout(static_cast<PatternFamily>(family), meter);
+        }
+    }
+    return layouts;
+}
 
-                    // Apply turn transformation
-                    auto transformed = applyTurnVariants(noteIndex, duration, DUPLE, selectedVariant);
-
-                    // Track variant usage
-                    state.variantUsageCount[selectedVariant]++;
-
-                    // Output the transformed notes
-                    for (const auto& [transformedNote, transformedDuration] : transformed) {
-                        std::string transNote = getNoteName(transformedNote); // Convert MIDI to readable name
-                        output << std::left
-                               << std::setw(11) << track
-                               << std::setw(11) << transNote
-                               << std::setw(20) << transformedDuration
-                               << std::setw(20) << label
-                               << std::setw(25) << selectedVariant
-                               << "\n";
+constexpr std::array<SegmentLayout, SEGMENT_LAYOUT_COUNT> SEGMENT_LAYOUTS = buildSegmentLayouts();
+
+// The layouts must reproduce the helpers exactly. Rounding repeats every 120 ticks
+// (the least common multiple of all divisors), so one period is a full check.
+constexpr bool segmentLayoutsMatchHelpers() {
+    for (int family = 0; family < PATTERN_FAMILY_COUNT; ++family) {
+        for (TimeMeter meter : {DUPLE, TRIPLE}) {
+            const SegmentLayout& layout = SEGMENT_LAYOUTS[segmentLayoutIndex(static_cast<PatternFamily>(family), meter)];
+            for (int durPi = 1; durPi <= 120; ++durPi) {
+                TurnExpansion expected;
+                expandPatternFamily(expected, static_cast<PatternFamily>(family), ROLE_PRINCIPAL, ROLE_UPPER,
+                                    ROLE_LOWER, ROLE_UNDER_LOWER, durPi, meter);
+                if (expected.count != layout.count) {
+                    return false;
+                }
+                int used = 0;
+                for (int k = 0; k < layout.count; ++k) {
+                    int duration = k + 1 < layout.count
+                        ? durPi * layout.numerators[k] / layout.denominators[k]
+                        : durPi - used;
+                    used += duration;
+                    if (expected.segments[k].pitch != layout.roles[k] || expected.segments[k].duration != duration) {
+                        return false;
                     }
-                } catch (const std::exception& e) {
-                    // Handle cases where getNoteNumber produces an error
-                    state.statusMessage += "Error processing note '" + noteName + "': " + e.what() + "\n";
                 }
-            } else {
-                // Output original data for notes not selected for transformation
-                output << std::left
-                       << std::setw(11) << track
-                       << std::setw(11) << noteName
-                       << std::setw(20) << duration
-                       << std::setw(20) << label
-                       << std::setw(25) << "ORIGINAL" // Mark as original
-                       << "\n";
             }
-        } else {
-            // Output original data for non-eligible labels
-            output << std::left
-                   << std::setw(11) << track
-                   << std::setw(11) << noteName
-                   << std::setw(20) << duration
-                   << std::setw(20) << label
-                   << std::setw(25) << "" // Empty variant column
-                   << "\n";
         }
     }
+    return true;
+}
+static_assert(segmentLayoutsMatchHelpers(), "SEGMENT_LAYOUTS must match the handleTurnMeter* helpers");
 
-    input.close();
-    output.close();
+// Per-variant pitch offsets as separate columns, so SIMD code can gather them by VariantId
+struct VariantOffsetColumns {
+    int upper[VARIANT_COUNT] = {};
+    int lower[VARIANT_COUNT] = {};
+    int underLower[VARIANT_COUNT] = {};
+};
 
-    // Calculate actual percentage
-    double actualPercentage = state.totalEligibleNotes > 0 ?
-        (static_cast<double>(state.transformedNotes) / state.totalEligibleNotes) * 100.0 : 0.0;
+constexpr VariantOffsetColumns buildVariantOffsetColumns() {
+    VariantOffsetColumns columns;
+    for (int i = 0; i < VARIANT_COUNT; ++i) {
+        columns.upper[i] = TURN_VARIANT_TABLE[i].upperOffset;
+        columns.lower[i] = TURN_VARIANT_TABLE[i].lowerOffset;
+        columns.underLower[i] = TURN_VARIANT_TABLE[i].underLowerOffset;
+    }
+    return columns;
+}
 
-    // Update result summary
-    std::stringstream summary;
-    summary << "Transformation Statistics:\n"
-            << "Total eligible notes found: " << state.totalEligibleNotes << "\n"
-            << "Notes transformed: " << state.transformedNotes << "\n"
-            << "Actual transformation percentage: " << std::fixed << std::setprecision(1)
-            << actualPercentage << "%\n\n";
+constexpr VariantOffsetColumns VARIANT_OFFSET_COLUMNS = buildVariantOffsetColumns();
 
-    if (state.selectedVariants.size() == 1 && state.selectedVariants[0] != "RANDOM") {
-        summary << "Variant used: " << state.selectedVariants[0] << "\n";
-    } else if (state.selectedVariants.size() > 1) {
-        summary << "Variants used (" << state.selectedVariants.size() << " total):\n";
-        for (const auto& [variant, count] : state.variantUsageCount) {
-            summary << "  " << variant << ": " << count << " times\n";
+// Precomputed pitch content of one variant for one principal pitch and meter.
+// Segment durations follow from SEGMENT_LAYOUTS[layout] and the note's duration.
+struct TurnPitchSequence {
+    std::uint8_t count = 0;     // Number of segments
+    std::uint8_t layout = 0;    // Index into SEGMENT_LAYOUTS
+    bool inRange = false;       // False if any segment pitch falls outside 0..127
+    std::uint8_t pitches[MAX_TURN_SEGMENTS] = {};
+};
+
+struct TurnPitchTable {
+    TurnPitchSequence entries[VARIANT_COUNT][2][MIDI_PITCH_COUNT];
+};
+
+constexpr TurnPitchTable buildTurnPitchTable() {
+    TurnPitchTable table{};
+    for (int variant = 0; variant < VARIANT_COUNT; ++variant) {
+        const VariantSpec& spec = TURN_VARIANT_TABLE[variant];
+        const int roleOffsets[4] = {0, spec.upperOffset, spec.lowerOffset, spec.underLowerOffset};
+        for (TimeMeter meter : {DUPLE, TRIPLE}) {
+            int layoutIndex = segmentLayoutIndex(spec.family, meter);
+            const SegmentLayout& layout = SEGMENT_LAYOUTS[layoutIndex];
+            for (int pi = 0; pi < MIDI_PITCH_COUNT; ++pi) {
+                TurnPitchSequence& entry = table.entries[variant][meter][pi];
+                entry.count = static_cast<std::uint8_t>(layout.count);
+                entry.layout = static_cast<std::uint8_t>(layoutIndex);
+                entry.inRange = true;
+                for (int k = 0; k < layout.count; ++k) {
+                    int pitch = pi + roleOffsets[layout.roles[k]];
+                    if (pitch < 0 || pitch >= MIDI_PITCH_COUNT) {
+                        entry.inRange = false;
+                        pitch = 0;
+                    }
+                    entry.pitches[k] = static_cast<std::uint8_t>(pitch);
+                }
+            }
         }
-    } else {
-        summary << "Variant selection: Random\n";
     }
-
-    summary << "Processing complete. Transformed results written to " << outputFile << "\n";
-    state.resultSummary = summary.str();
-    state.statusMessage = "Processing complete!";
-    state.processingComplete = true;
+    return table;
 }
 
-// Function to convert processed data to MIDI file with MIDI sync fix
-void convertToMidi(const std::string& inputFile, const std::string& outputFile, AppState& state) {
-    std::ifstream input(inputFile);
-    if (!input.is_open()) {
-        state.statusMessage += "Error opening input file: " + inputFile + "\n";
-        return;
-    }
+constexpr TurnPitchTable TURN_PITCH_TABLE = buildTurnPitchTable();
 
-    // Skip header lines
-    std::string line;
-    std::getline(input, line); // Skip column headers
-    std::getline(input, line); // Skip separator line
+// Precomputed pitch sequence of a turn, or nullptr if pi is not a MIDI pitch
+const TurnPitchSequence* findTurnPitchSequence(int pi, TimeMeter meter, VariantId variant) {
+    if (pi < 0 || pi >= MIDI_PITCH_COUNT || (meter != DUPLE && meter != TRIPLE) || variant >= VariantId::Count) {
+        return nullptr;
+    }
+    return &TURN_PITCH_TABLE.entries[static_cast<int>(variant)][meter][pi];
+}
 
-    // Parse the file and collect note events
-    std::map<int, std::vector<MidiEvent>> trackEvents;
-    std::map<int, int> trackPositions; // FIXED: Track positions for sequential notes within each track
+// Check whether every note of a turn on pitch pi is a valid MIDI pitch
+bool turnStaysInMidiRange(int pi, TimeMeter meter, VariantId variant) {
+    const TurnPitchSequence* sequence = findTurnPitchSequence(pi, meter, variant);
+    return sequence != nullptr && sequence->inRange;
+}
 
-    while (std::getline(input, line)) {
-        std::istringstream ss(line);
-        int track;
-        std::string noteName;
-        int duration;
-        std::string label, variant;
+// Check whether the running CPU (and OS) support AVX2
+bool cpuSupportsAvx2() {
+#if defined(TURNS_HAVE_X86) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#elif defined(TURNS_HAVE_X86)
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
 
-        // Skip lines that don't contain note data
-        if (line.empty() || line[0] == '-' || line.find("MIDI File Analyzed") != std::string::npos) {
-            continue;
-        }
+bool batchKernelAvailable(BatchKernel kernel) {
+    static const bool hasAvx2 = cpuSupportsAvx2();
+    return kernel != BatchKernel::Avx2 || hasAvx2;
+}
 
-        // Parse the line
-        if (!(ss >> track >> noteName >> duration)) {
-            continue; // Skip malformed lines
-        }
+// Scalar kernel: expand note by note straight into the output buffer
+void expandTurnsBatchScalar(const int* pitches, const int* durations, const VariantId* variants,
+                            const TimeMeter* meters, std::size_t count, TurnBatch& out) {
+    out.segments.resize(count * MAX_TURN_SEGMENTS);
 
-        // Skip header or non-note lines
-        if (noteName == "Note" || noteName == "Track") {
-            continue;
+    SegmentWriter writer{out.segments.data()};
+    for (std::size_t i = 0; i < count; ++i) {
+        out.offsets[i] = static_cast<std::uint32_t>(writer.cursor - out.segments.data());
+        if (variants[i] < VariantId::Count && turnArgumentError(durations[i], meters[i]) == nullptr) {
+            expandTurnFamily(writer, pitches[i], durations[i], meters[i], variants[i]);
         }
+    }
 
-        try {
-            int noteNumber = getNoteNumber(noteName);
+    std::size_t used = writer.cursor - out.segments.data();
+    out.offsets[count] = static_cast<std::uint32_t>(used);
+    out.segments.resize(used);
+}
 
-            // FIXED: Use track-specific positioning for sequential notes within each track
-            int& trackPosition = trackPositions[track];
+#ifdef TURNS_HAVE_X86
+// Unsigned divide of eight lanes by a layout divisor (see SegmentLayout)
+TURNS_TARGET_AVX2
+__m256i divideByLayoutAvx2(__m256i dividend, std::uint32_t multiplier, int shift) {
+    __m128i count = _mm_cvtsi32_si128(shift);
+    if (multiplier == 0) {
+        return _mm256_srl_epi32(dividend, count);
+    }
+    __m256i factor = _mm256_set1_epi32(static_cast<int>(multiplier));
+    __m256i even = _mm256_srl_epi64(_mm256_mul_epu32(dividend, factor), count);
+    __m256i odd = _mm256_srl_epi64(_mm256_mul_epu32(_mm256_srli_epi64(dividend, 32), factor), count);
+    return _mm256_blend_epi32(even, _mm256_slli_epi64(odd, 32), 0xAA);
+}
 
-            // Create note-on event at the track's current position
-            MidiEvent noteOn{track, noteNumber, trackPosition, duration, true};
-            trackEvents[track].push_back(noteOn);
+// Expand a group of valid notes that share one layout, eight at a time
+TURNS_TARGET_AVX2
+void expandLayoutGroupAvx2(const SegmentLayout& layout, TimeMeter meter, const std::uint32_t* notes, std::size_t count,
+                           const int* pitches, const int* durations, const VariantId* variants,
+                           const std::uint32_t* offsets, Segment* out) {
+    alignas(32) Segment slotSegments[MAX_TURN_SEGMENTS][8];
+    alignas(32) int variantIndices[8];
+    const int last = layout.count - 1;
+
+    std::size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i index = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(notes + i));
+        __m256i pi = _mm256_i32gather_epi32(pitches, index, 4);
+        __m256i durPi = _mm256_i32gather_epi32(durations, index, 4);
+        for (int lane = 0; lane < 8; ++lane) {
+            variantIndices[lane] = static_cast<int>(variants[notes[i + lane]]);
+        }
+        __m256i variant = _mm256_load_si256(reinterpret_cast<const __m256i*>(variantIndices));
+
+        // Candidate pitches, indexed by PitchRole
+        __m256i roles[4] = {
+            pi,
+            _mm256_add_epi32(pi, _mm256_i32gather_epi32(VARIANT_OFFSET_COLUMNS.upper, variant, 4)),
+            _mm256_add_epi32(pi, _mm256_i32gather_epi32(VARIANT_OFFSET_COLUMNS.lower, variant, 4)),
+            _mm256_add_epi32(pi, _mm256_i32gather_epi32(VARIANT_OFFSET_COLUMNS.underLower, variant, 4))
+        };
 
-            // Create note-off event
-            MidiEvent noteOff{track, noteNumber, trackPosition + duration, 0, false};
-            trackEvents[track].push_back(noteOff);
+        __m256i used = _mm256_setzero_si256();
+        for (int k = 0; k <= last; ++k) {
+            __m256i duration;
+            if (k < last) {
+                __m256i scaled = layout.numerators[k] == 1
+                    ? durPi
+                    : _mm256_mullo_epi32(durPi, _mm256_set1_epi32(layout.numerators[k]));
+                duration = divideByLayoutAvx2(scaled, layout.multipliers[k], layout.shifts[k]);
+                used = _mm256_add_epi32(used, duration);
+            } else {
+                duration = _mm256_sub_epi32(durPi, used);  // Remaining duration
+            }
 
-            // Update the position for this track (notes within a track are sequential)
-            trackPosition += duration;
+            // Interleave pitch and duration into eight Segment values for lanes 0-3 and 4-7
+            __m256i pitch = roles[layout.roles[k]];
+            __m256i low = _mm256_unpacklo_epi32(pitch, duration);
+            __m256i high = _mm256_unpackhi_epi32(pitch, duration);
+            _mm256_store_si256(reinterpret_cast<__m256i*>(&slotSegments[k][0]), _mm256_permute2x128_si256(low, high, 0x20));
+            _mm256_store_si256(reinterpret_cast<__m256i*>(&slotSegments[k][4]), _mm256_permute2x128_si256(low, high, 0x31));
+        }
 
-        } catch (const std::exception& e) {
-            state.statusMessage += "Error processing note '" + noteName + "': " + std::string(e.what()) + "\n";
+        // Scatter the eight expansions to their places in the output
+        for (int lane = 0; lane < 8; ++lane) {
+            Segment* segment = out + offsets[notes[i + lane]];
+            for (int k = 0; k <= last; ++k) {
+                segment[k] = slotSegments[k][lane];
+            }
         }
     }
 
-    input.close();
+    // Remaining notes of the group
+    for (; i < count; ++i) {
+        std::uint32_t note = notes[i];
+        SegmentWriter writer{out + offsets[note]};
+        expandTurnFamily(writer, pitches[note], durations[note], meter, variants[note]);
+    }
+}
 
-    // Write MIDI file
-    std::ofstream midiFile(outputFile, std::ios::binary);
-    if (!midiFile.is_open()) {
-        state.statusMessage += "Error opening output MIDI file: " + outputFile + "\n";
+// Notes grouped per step of the AVX2 kernel, small enough for the groups to stay in cache
+constexpr std::size_t AVX2_GROUPING_BLOCK = 2048;
+
+// AVX2 kernel: compute offsets, then per cache-sized block group the notes by
+// segment layout and expand each group
+TURNS_TARGET_AVX2
+void expandTurnsBatchAvx2(const int* pitches, const int* durations, const VariantId* variants,
+                          const TimeMeter* meters, std::size_t count, TurnBatch& out) {
+    std::uint32_t used = 0;
+    for (std::size_t i = 0; i < count; ++i) {
+        out.offsets[i] = used;
+        if (variants[i] < VariantId::Count && turnArgumentError(durations[i], meters[i]) == nullptr) {
+            int layout = segmentLayoutIndex(TURN_VARIANT_TABLE[static_cast<int>(variants[i])].family, meters[i]);
+            used += SEGMENT_LAYOUTS[layout].count;
+        }
+    }
+    out.offsets[count] = used;
+    out.segments.resize(used);
+    out.grouped.resize(SEGMENT_LAYOUT_COUNT * AVX2_GROUPING_BLOCK);
+
+    for (std::size_t blockStart = 0; blockStart < count; blockStart += AVX2_GROUPING_BLOCK) {
+        std::size_t blockEnd = std::min(count, blockStart + AVX2_GROUPING_BLOCK);
+        std::array<std::size_t, SEGMENT_LAYOUT_COUNT> groupSize{};
+        for (std::size_t i = blockStart; i < blockEnd; ++i) {
+            if (out.offsets[i + 1] != out.offsets[i]) {
+                int layout = segmentLayoutIndex(TURN_VARIANT_TABLE[static_cast<int>(variants[i])].family, meters[i]);
+                out.grouped[layout * AVX2_GROUPING_BLOCK + groupSize[layout]++] = static_cast<std::uint32_t>(i);
+            }
+        }
+
+        for (int layout = 0; layout < SEGMENT_LAYOUT_COUNT; ++layout) {
+            expandLayoutGroupAvx2(SEGMENT_LAYOUTS[layout], static_cast<TimeMeter>(layout % 2),
+                                  out.grouped.data() + layout * AVX2_GROUPING_BLOCK, groupSize[layout],
+                                  pitches, durations, variants, out.offsets.data(), out.segments.data());
+        }
+    }
+}
+#endif
+
+// Expand a whole buffer of notes given as parallel arrays in one pass.
+// Notes with invalid arguments or an unknown variant get no segments;
+// callers that need an error message check turnArgumentError first.
+void expandTurnsBatch(const int* pitches, const int* durations, const VariantId* variants,
+                      const TimeMeter* meters, std::size_t count, TurnBatch& out,
+                      BatchKernel kernel) {
+    out.offsets.resize(count + 1);
+
+#ifdef TURNS_HAVE_X86
+    if ((kernel == BatchKernel::Auto || kernel == BatchKernel::Avx2) && batchKernelAvailable(BatchKernel::Avx2)) {
+        expandTurnsBatchAvx2(pitches, durations, variants, meters, count, out);
         return;
     }
+#endif
+    expandTurnsBatchScalar(pitches, durations, variants, meters, count, out);
+}
 
-    // Write MIDI header
-    // Format: MThd + <length> + <format> + <tracks> + <division>
-    midiFile.write("MThd", 4); // Chunk type
+// splitmix64 step: advances `x` and returns a well-mixed 64-bit value
+constexpr std::uint64_t splitMix64(std::uint64_t& x) {
+    std::uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
 
-    // Header length (always 6 bytes)
-    char headerLength[4] = {0, 0, 0, 6};
-    midiFile.write(headerLength, 4);
+constexpr std::uint64_t rotateLeft(std::uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
 
-    // Format (0 = single track, 1 = multiple tracks, same timebase)
-    char format[2] = {0, 1};
-    midiFile.write(format, 2);
+// Map a 32-bit random value to [0, bound) with a multiply-shift reduction
+// (no division; the bias is at most bound / 2^32)
+constexpr std::uint32_t reduceToRange(std::uint32_t value, std::uint32_t bound) {
+    return static_cast<std::uint32_t>((static_cast<std::uint64_t>(value) * bound) >> 32);
+}
 
-    // Number of tracks
-    int numTracks = trackEvents.size();
-    char tracksCount[2] = {static_cast<char>((numTracks >> 8) & 0xFF),
-                          static_cast<char>(numTracks & 0xFF)};
-    midiFile.write(tracksCount, 2);
+// Bernoulli test for "transform this note": a 64-bit draw succeeds with
+// probability percentage/100 through one integer compare
+struct TransformChance {
+    std::uint64_t threshold = 0;
+    bool always = false;
 
-    // Division (ticks per quarter note = 1024)
-    char division[2] = {0x04, 0x00}; // 1024 in big-endian
-    midiFile.write(division, 2);
+    bool accepts(std::uint64_t value) const {
+        return always || value < threshold;
+    }
+};
 
-    // Write each track
-    for (const auto& [trackNum, events] : trackEvents) {
-        // Sort events by time
-        std::vector<MidiEvent> sortedEvents = events;
-        std::sort(sortedEvents.begin(), sortedEvents.end(),
-                 [](const MidiEvent& a, const MidiEvent& b) {
-                     return a.startTime < b.startTime ||
-                            (a.startTime == b.startTime && !a.isNoteOn && b.isNoteOn);
-                 });
+TransformChance makeTransformChance(double transformationPercentage) {
+    TransformChance chance;
+    chance.always = transformationPercentage >= 100.0;
+    if (transformationPercentage > 0.0 && !chance.always) {
+        chance.threshold = static_cast<std::uint64_t>(std::ldexp(transformationPercentage / 100.0, 64));
+    }
+    return chance;
+}
 
-        // Write track header
-        midiFile.write("MTrk", 4);
+// Philox4x32-10 counter-based generator (Salmon et al., "Parallel random numbers:
+// as easy as 1, 2, 3"). The output depends only on the counter and the key.
+std::array<std::uint32_t, 4> philox4x32(std::array<std::uint32_t, 4> counter,
+                                        std::array<std::uint32_t, 2> key) {
+    constexpr std::uint32_t MULTIPLIER_0 = 0xD2511F53;
+    constexpr std::uint32_t MULTIPLIER_1 = 0xCD9E8D57;
+    constexpr std::uint32_t WEYL_0 = 0x9E3779B9;
+    constexpr std::uint32_t WEYL_1 = 0xBB67AE85;
+
+    for (int round = 0; round < 10; ++round) {
+        std::uint64_t product0 = static_cast<std::uint64_t>(MULTIPLIER_0) * counter[0];
+        std::uint64_t product1 = static_cast<std::uint64_t>(MULTIPLIER_1) * counter[2];
+        counter = {static_cast<std::uint32_t>(product1 >> 32) ^ counter[1] ^ key[0],
+                   static_cast<std::uint32_t>(product1),
+                   static_cast<std::uint32_t>(product0 >> 32) ^ counter[3] ^ key[1],
+                   static_cast<std::uint32_t>(product0)};
+        key[0] += WEYL_0;
+        key[1] += WEYL_1;
+    }
+    return counter;
+}
 
-        // Placeholder for track length (will be filled in later)
-        long trackLengthPos = midiFile.tellp();
-        midiFile.write("\0\0\0\0", 4);
+// Random draws for one input line
+struct LineDraws {
+    std::uint64_t transform;  // Compared against the TransformChance
+    std::uint32_t variant;    // Reduced to a variant index
+};
 
-        // Track start position
-        long trackStartPos = midiFile.tellp();
+// The draws of a line depend only on (seed, track, line index), never on how
+// many lines were processed before it, so any split of the input into chunks
+// or threads gives the same result
+LineDraws drawForLine(std::uint64_t seed, int track, std::uint64_t lineIndex) {
+    std::array<std::uint32_t, 4> bits = philox4x32(
+        {static_cast<std::uint32_t>(lineIndex), static_cast<std::uint32_t>(lineIndex >> 32),
+         static_cast<std::uint32_t>(track), 0},
+        {static_cast<std::uint32_t>(seed), static_cast<std::uint32_t>(seed >> 32)});
+    return {(static_cast<std::uint64_t>(bits[0]) << 32) | bits[1], bits[2]};
+}
 
-        // Write track events
-        int lastTime = 0;
+// Parse user input for multiple choice selection
+std::vector<int> parseUserChoices(const std::string& input, int maxChoice) {
+    std::vector<int> choices;
+    std::istringstream iss(input);
+    std::string token;
 
-        // Set instrument (program change) - using piano (0) as default
-        char programChange[3] = {0x00, static_cast<char>(0xC0), 0x00}; // Delta time, command, program number
-        midiFile.write(programChange, 3);
-
-        for (const auto& event : sortedEvents) {
-            // Write delta time (variable length)
-            int deltaTime = event.startTime - lastTime;
-            lastTime = event.startTime;
-
-            // Convert delta time to variable length quantity
-            std::vector<char> vlq;
-            if (deltaTime == 0) {
-                vlq.push_back(0);
-            } else {
-                while (deltaTime > 0) {
-                    char byte = deltaTime & 0x7F;
-                    deltaTime >>= 7;
-                    if (!vlq.empty()) {
-                        byte |= 0x80;
-                    }
-                    vlq.push_back(byte);
+    while (iss >> token) {
+        try {
+            int choice = std::stoi(token);
+            if (choice >= 1 && choice <= maxChoice) {
+                // Avoid duplicates
+                if (std::find(choices.begin(), choices.end(), choice) == choices.end()) {
+                    choices.push_back(choice);
                 }
-                std::reverse(vlq.begin(), vlq.end());
             }
+        } catch (const std::exception&) {
+            // Ignore invalid tokens
+        }
+    }
 
-            for (char byte : vlq) {
-                midiFile.put(byte);
+    return choices;
+}
+
+// Structure to represent a MIDI note event, packed into 8 bytes. Events are
+// stored per track, so the track is implicit. Bits 0-6 hold the velocity,
+// bits 7-13 the note number, bit 14 is set for note-on and bits 24-63 hold
+// the tick as a signed 40-bit value offset by 2^39, so the packed events
+// compare in time order.
+class MidiEvent {
+public:
+    MidiEvent() = default;
+    MidiEvent(std::int64_t tick, int noteNumber, bool isNoteOn, int velocity)
+        : bits(((static_cast<std::uint64_t>(tick + TICK_OFFSET) & TICK_MASK) << 24) |
+               (static_cast<std::uint64_t>(isNoteOn) << 14) |
+               (static_cast<std::uint64_t>(noteNumber & 0x7F) << 7) |
+               static_cast<std::uint64_t>(velocity & 0x7F)) {}
+
+    std::int64_t tick() const { return static_cast<std::int64_t>(bits >> 24) - TICK_OFFSET; }
+    int noteNumber() const { return static_cast<int>((bits >> 7) & 0x7F); }
+    bool isNoteOn() const { return ((bits >> 14) & 1) != 0; }
+    int velocity() const { return static_cast<int>(bits & 0x7F); }
+
+    // Orders by tick, note-offs before note-ons, then pitch and velocity
+    std::uint64_t sortKey() const { return bits; }
+
+private:
+    static constexpr std::int64_t TICK_OFFSET = std::int64_t(1) << 39;
+    static constexpr std::uint64_t TICK_MASK = (std::uint64_t(1) << 40) - 1;
+    std::uint64_t bits = 0;
+};
+static_assert(sizeof(MidiEvent) == 8, "MIDI events are packed into 8 bytes");
+
+// Velocity of every note-on
+constexpr int NOTE_ON_VELOCITY = 100;
+
+// Variant of a note that was not transformed: VariantId values are followed
+// by these two, which also serve as variant ids in note files
+constexpr std::uint8_t ORIGINAL_NOTE_VARIANT = VARIANT_COUNT;      // Eligible, not selected
+constexpr std::uint8_t PLAIN_NOTE_VARIANT = VARIANT_COUNT + 1;     // Not eligible
+static_assert(VARIANT_COUNT + 2 <= 256, "note variants must fit in a byte");
+
+// A note for the MIDI file; the notes of one track play one after another
+struct MidiNote {
+    int track;
+    int noteNumber;
+    int duration;
+    std::string_view label;  // Points into the input while it is processed
+    std::uint8_t variant = PLAIN_NOTE_VARIANT;
+};
+
+// The note-on events of one track, a slice of the builder's arena. Notes of
+// a track follow each other, so each note-off is implied at the next note's
+// tick, or at the end of the track for the last one.
+struct MidiTrack {
+    int number = 0;
+    const MidiEvent* noteOns = nullptr;
+    std::size_t noteCount = 0;
+    std::int64_t endTick = 0;
+    bool sequential = true;   // All durations positive: every note ends before the next starts
+
+    std::int64_t noteEnd(std::size_t n) const {
+        return n + 1 < noteCount ? noteOns[n + 1].tick() : endTick;
+    }
+};
+
+// Track numbers below this are remapped through a table, others through a hash map
+constexpr int DIRECT_TRACK_LIMIT = 1 << 16;
+
+// Dense indices for sparse track numbers, in order of first appearance
+class TrackRemap {
+public:
+    std::uint32_t indexOf(int track) {
+        if (track == lastTrack && lastIndex != UNASSIGNED) {
+            return lastIndex;
+        }
+        std::uint32_t* slot;
+        if (track >= 0 && track < DIRECT_TRACK_LIMIT) {
+            if (static_cast<std::size_t>(track) >= direct.size()) {
+                direct.resize(std::max<std::size_t>(track + 1, direct.size() * 2), UNASSIGNED);
+            }
+            slot = &direct[track];
+        } else {
+            slot = &sparse.emplace(track, UNASSIGNED).first->second;
+        }
+        if (*slot == UNASSIGNED) {
+            *slot = static_cast<std::uint32_t>(numbers.size());
+            numbers.push_back(track);
+        }
+        lastTrack = track;
+        lastIndex = *slot;
+        return lastIndex;
+    }
+
+    // Track number of every index
+    const std::vector<int>& trackNumbers() const {
+        return numbers;
+    }
+
+private:
+    static constexpr std::uint32_t UNASSIGNED = 0xFFFFFFFF;
+    std::vector<std::uint32_t> direct;
+    std::unordered_map<int, std::uint32_t> sparse;
+    std::vector<int> numbers;
+    int lastTrack = 0;
+    std::uint32_t lastIndex = UNASSIGNED;
+};
+
+// Note events of every track, as written by writeMidiFile. All note-ons live
+// in one arena, sized by a counting pass, where every track owns a
+// contiguous slice; tracks are ordered by track number.
+class MidiEventBuilder {
+public:
+    MidiEventBuilder() = default;
+    MidiEventBuilder(const MidiEventBuilder&) = delete;  // Tracks point into the arena
+    MidiEventBuilder& operator=(const MidiEventBuilder&) = delete;
+
+    // `notes` is any indexed sequence of MidiNote-like values in input order
+    template <typename Notes>
+    void addNotes(const Notes& notes) {
+        // Counting pass: the dense track index of every note and the notes per track
+        TrackRemap remap;
+        std::vector<std::uint32_t> noteTracks(notes.size());
+        std::vector<std::size_t> counts;
+        for (std::size_t i = 0; i < notes.size(); ++i) {
+            std::uint32_t index = remap.indexOf(notes[i].track);
+            if (index == counts.size()) {
+                counts.push_back(0);
+            }
+            noteTracks[i] = index;
+            ++counts[index];
+        }
+
+        // Slices in track number order
+        const std::vector<int>& numbers = remap.trackNumbers();
+        std::vector<std::uint32_t> order(numbers.size());
+        for (std::uint32_t i = 0; i < order.size(); ++i) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(),
+                  [&](std::uint32_t a, std::uint32_t b) { return numbers[a] < numbers[b]; });
+        events.resize(notes.size());
+        tracks.resize(numbers.size());
+        std::vector<std::size_t> cursors(numbers.size());
+        std::size_t offset = 0;
+        for (std::size_t position = 0; position < order.size(); ++position) {
+            std::uint32_t index = order[position];
+            cursors[index] = offset;
+            tracks[position].number = numbers[index];
+            tracks[position].noteOns = events.data() + offset;
+            tracks[position].noteCount = counts[index];
+            offset += counts[index];
+        }
+        std::vector<std::uint32_t> trackPositions(numbers.size());
+        for (std::size_t position = 0; position < order.size(); ++position) {
+            trackPositions[order[position]] = static_cast<std::uint32_t>(position);
+        }
+
+        // Fill each track's slice in input order, every note starting where the previous one ends
+        for (std::size_t i = 0; i < notes.size(); ++i) {
+            const auto& note = notes[i];
+            MidiTrack& track = tracks[trackPositions[noteTracks[i]]];
+
+            // Create note-on event at the track's current position
+            events[cursors[noteTracks[i]]++] = MidiEvent(track.endTick, note.noteNumber, true, NOTE_ON_VELOCITY);
+            track.sequential = track.sequential && note.duration > 0;
+
+            // Update the position for this track (notes within a track are sequential)
+            track.endTick += note.duration;
+        }
+    }
+
+    const std::vector<MidiTrack>& trackList() const {
+        return tracks;
+    }
+
+private:
+    std::vector<MidiEvent> events;
+    std::vector<MidiTrack> tracks;
+};
+
+// Labels eligible for transformation when no label file is given
+constexpr std::string_view DEFAULT_ELIGIBLE_LABELS[] = {
+    "I8", "U2R", "SPD", "CH", "CW", "CD", "HT", "FM", "SLP", "RN", "LAD", "DNW", "SAN",
+    "RTR2", "TNTDN", "SMP", "LP", "DHT", "LNR", "TNTLN", "TNTTN", "RTD2"
+};
+
+using LabelId = std::uint32_t;
+constexpr LabelId UNKNOWN_LABEL = 0xFFFFFFFF;
+
+// Interned labels. Every known label gets a dense id through a two-level
+// perfect hash (hash and displace): the label's hash picks a bucket, and the
+// bucket's displacement moves its few labels to free slots, so the tables
+// stay linear in the label count. A lookup costs two multiplies and one
+// compare, and eligibility is one bit per id. The default labels always come
+// first, so their ids do not depend on the label file.
+struct LabelDictionary {
+    std::vector<std::string> names;      // Label text by id
+    std::vector<std::uint32_t> displacements;  // Per bucket
+    std::vector<LabelId> slots;          // Hash slot -> id, UNKNOWN_LABEL if empty
+    std::uint64_t multiplier = 0;
+    int bucketShift = 63;
+    int slotShift = 63;
+    std::vector<std::uint64_t> eligible; // Eligibility bitset indexed by id
+};
+
+// Fold the bytes of a label into one word; labels of up to 8 bytes map to distinct words
+inline std::uint64_t labelWord(std::string_view label) {
+    std::uint64_t word = label.size();
+    for (std::size_t i = 0; i < label.size(); i += 8) {
+        std::uint64_t chunk = 0;
+        std::memcpy(&chunk, label.data() + i, std::min<std::size_t>(8, label.size() - i));
+        word = i == 0 ? rotateLeft(word, 56) ^ chunk : (word ^ chunk) * 0x9E3779B97F4A7C15ULL;
+    }
+    return word;
+}
+
+// Slot of a label hash `hash` (labelWord times the dictionary's multiplier)
+// under displacement `displacement`
+inline std::size_t labelSlot(const LabelDictionary& dictionary, std::uint64_t hash, std::uint32_t displacement) {
+    return static_cast<std::size_t>(((hash ^ displacement) * 0xD6E8FEB86659FD93ULL) >> dictionary.slotShift);
+}
+
+// Id of a label, or UNKNOWN_LABEL
+inline LabelId findLabelId(const LabelDictionary& dictionary, std::string_view label) {
+    std::uint64_t hash = labelWord(label) * dictionary.multiplier;
+    std::uint32_t displacement = dictionary.displacements[hash >> dictionary.bucketShift];
+    LabelId id = dictionary.slots[labelSlot(dictionary, hash, displacement)];
+    return id != UNKNOWN_LABEL && dictionary.names[id] == label ? id : UNKNOWN_LABEL;
+}
+
+inline bool labelIsEligible(const LabelDictionary& dictionary, LabelId id) {
+    return id != UNKNOWN_LABEL && (dictionary.eligible[id / 64] >> (id % 64) & 1);
+}
+
+// Displacements tried per bucket before the multiplier is given up
+constexpr std::uint32_t MAX_LABEL_DISPLACEMENT = 1 << 16;
+
+// Try a hash multiplier: place the buckets, largest first, each at the first
+// displacement that puts all its labels in free slots. False if a bucket
+// finds none, or two labels have the same hash.
+bool placeLabels(LabelDictionary& dictionary, std::uint64_t multiplier, int bucketBits, int slotBits) {
+    dictionary.multiplier = multiplier;
+    dictionary.bucketShift = 64 - bucketBits;
+    dictionary.slotShift = 64 - slotBits;
+    dictionary.displacements.assign(std::size_t{1} << bucketBits, 0);
+    dictionary.slots.assign(std::size_t{1} << slotBits, UNKNOWN_LABEL);
+
+    // Labels grouped by bucket
+    std::vector<std::uint64_t> hashes(dictionary.names.size());
+    std::vector<std::uint32_t> bucketStarts((std::size_t{1} << bucketBits) + 1, 0);
+    for (LabelId id = 0; id < hashes.size(); ++id) {
+        hashes[id] = labelWord(dictionary.names[id]) * multiplier;
+        ++bucketStarts[(hashes[id] >> dictionary.bucketShift) + 1];
+    }
+    for (std::size_t b = 1; b < bucketStarts.size(); ++b) {
+        bucketStarts[b] += bucketStarts[b - 1];
+    }
+    std::vector<LabelId> bucketLabels(hashes.size());
+    std::vector<std::uint32_t> cursors(bucketStarts.begin(), bucketStarts.end() - 1);
+    for (LabelId id = 0; id < hashes.size(); ++id) {
+        bucketLabels[cursors[hashes[id] >> dictionary.bucketShift]++] = id;
+    }
+
+    std::vector<std::uint32_t> order(dictionary.displacements.size());
+    for (std::uint32_t b = 0; b < order.size(); ++b) {
+        order[b] = b;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b) {
+        return bucketStarts[a + 1] - bucketStarts[a] > bucketStarts[b + 1] - bucketStarts[b];
+    });
+
+    std::vector<std::size_t> placed;
+    for (std::uint32_t bucket : order) {
+        const LabelId* first = bucketLabels.data() + bucketStarts[bucket];
+        const LabelId* last = bucketLabels.data() + bucketStarts[bucket + 1];
+        if (first == last) {
+            break;  // Buckets are sorted by size, the rest are empty
+        }
+        std::uint32_t displacement = 0;
+        for (;; ++displacement) {
+            if (displacement == MAX_LABEL_DISPLACEMENT) {
+                return false;
+            }
+            placed.clear();
+            for (const LabelId* id = first; id != last; ++id) {
+                std::size_t slot = labelSlot(dictionary, hashes[*id], displacement);
+                if (dictionary.slots[slot] != UNKNOWN_LABEL) {
+                    break;
+                }
+                dictionary.slots[slot] = *id;
+                placed.push_back(slot);
+            }
+            if (placed.size() == static_cast<std::size_t>(last - first)) {
+                break;
+            }
+            for (std::size_t slot : placed) {
+                dictionary.slots[slot] = UNKNOWN_LABEL;
+            }
+        }
+        dictionary.displacements[bucket] = displacement;
+    }
+    return true;
+}
+
+// Multipliers tried before the label set is given up; each one fails rarely
+constexpr int MAX_LABEL_HASH_ATTEMPTS = 64;
+
+// Intern the default labels and `eligibleLabels`, then build the perfect hash:
+// about four labels per bucket and at least twice as many slots as labels.
+// Without `eligibleLabels` the default labels are eligible; a given list must
+// not be empty.
+LabelDictionary buildLabelDictionary(const std::vector<std::string>* eligibleLabels) {
+    if (eligibleLabels != nullptr && eligibleLabels->empty()) {
+        throw std::invalid_argument("No labels given");
+    }
+    LabelDictionary dictionary;
+    std::unordered_map<std::string, LabelId> ids;
+    auto intern = [&](std::string_view label) {
+        auto [it, inserted] = ids.emplace(std::string(label), static_cast<LabelId>(dictionary.names.size()));
+        if (inserted) {
+            dictionary.names.push_back(it->first);
+        }
+    };
+    for (std::string_view label : DEFAULT_ELIGIBLE_LABELS) {
+        intern(label);
+    }
+    if (eligibleLabels != nullptr) {
+        for (const std::string& label : *eligibleLabels) {
+            intern(label);
+        }
+    }
+
+    int bucketBits = 1;
+    while ((std::size_t{4} << bucketBits) < dictionary.names.size()) {
+        ++bucketBits;
+    }
+    int slotBits = 1;
+    while ((std::size_t{1} << slotBits) < dictionary.names.size() * 2) {
+        ++slotBits;
+    }
+    std::uint64_t candidateSeed = 0;
+    for (int attempt = 0; !placeLabels(dictionary, splitMix64(candidateSeed) | 1, bucketBits, slotBits); ++attempt) {
+        if (attempt == MAX_LABEL_HASH_ATTEMPTS) {
+            throw std::invalid_argument("Cannot build a perfect hash for the label set");
+        }
+    }
+
+    dictionary.eligible.assign((dictionary.names.size() + 63) / 64, 0);
+    auto markEligible = [&](std::string_view label) {
+        LabelId id = findLabelId(dictionary, label);
+        dictionary.eligible[id / 64] |= std::uint64_t{1} << (id % 64);
+    };
+    if (eligibleLabels == nullptr) {
+        for (std::string_view label : DEFAULT_ELIGIBLE_LABELS) {
+            markEligible(label);
+        }
+    } else {
+        for (const std::string& label : *eligibleLabels) {
+            markEligible(label);
+        }
+    }
+    return dictionary;
+}
+
+// Read eligible labels from a text file: whitespace-separated, '#' starts a comment
+bool loadLabelFile(const std::string& path, std::vector<std::string>& labels) {
+    std::ifstream input(path);
+    if (!input.is_open()) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(input, line)) {
+        std::istringstream tokens(line.substr(0, line.find('#')));
+        std::string label;
+        while (tokens >> label) {
+            labels.push_back(label);
+        }
+    }
+    return true;
+}
+
+// Read-only view of a whole input file. The file is memory-mapped, so lines can
+// be parsed in place without copying them out of the page cache.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+#if defined(_WIN32) || defined(_WIN64)
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                           FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE) {
+            return;
+        }
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize)) {
+            return;
+        }
+        size = static_cast<std::size_t>(fileSize.QuadPart);
+        opened = true;
+        if (size == 0) {
+            return;
+        }
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping != NULL) {
+            data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        }
+        opened = data != nullptr;
+#else
+        descriptor = open(path.c_str(), O_RDONLY);
+        if (descriptor < 0) {
+            return;
+        }
+        struct stat fileStatus;
+        if (fstat(descriptor, &fileStatus) != 0 || !S_ISREG(fileStatus.st_mode)) {
+            return;
+        }
+        size = static_cast<std::size_t>(fileStatus.st_size);
+        opened = true;
+        if (size == 0) {
+            return;
+        }
+        void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+        if (mapped != MAP_FAILED) {
+            data = static_cast<const char*>(mapped);
+            madvise(mapped, size, MADV_SEQUENTIAL);
+        }
+        opened = data != nullptr;
+#endif
+    }
+
+    ~MappedFile() {
+#if defined(_WIN32) || defined(_WIN64)
+        if (data != nullptr) {
+            UnmapViewOfFile(data);
+        }
+        if (mapping != NULL) {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+#else
+        if (data != nullptr) {
+            munmap(const_cast<char*>(data), size);
+        }
+        if (descriptor >= 0) {
+            close(descriptor);
+        }
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool isOpen() const {
+        return opened;
+    }
+
+    std::string_view contents() const {
+        return data != nullptr ? std::string_view(data, size) : std::string_view();
+    }
+
+private:
+    const char* data = nullptr;
+    std::size_t size = 0;
+    bool opened = false;
+#if defined(_WIN32) || defined(_WIN64)
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#else
+    int descriptor = -1;
+#endif
+};
+
+// Whitespace as seen by stream extraction in the "C" locale
+constexpr bool isFieldSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+// Parse an int field like `stream >> value`: skip whitespace, optional sign, decimal digits
+inline bool parseIntField(std::string_view line, std::size_t& position, int& value) {
+    while (position < line.size() && isFieldSpace(line[position])) {
+        ++position;
+    }
+    std::size_t start = position;
+    if (start < line.size() && line[start] == '+') {
+        ++start;
+        if (start == line.size() || line[start] < '0' || line[start] > '9') {
+            return false;
+        }
+    }
+    auto [end, error] = std::from_chars(line.data() + start, line.data() + line.size(), value);
+    if (error != std::errc()) {
+        return false;
+    }
+    position = static_cast<std::size_t>(end - line.data());
+    return true;
+}
+
+// Parse a string field like `stream >> word`: skip whitespace, take up to the next whitespace
+inline bool parseWordField(std::string_view line, std::size_t& position, std::string_view& word) {
+    while (position < line.size() && isFieldSpace(line[position])) {
+        ++position;
+    }
+    std::size_t start = position;
+    while (position < line.size() && !isFieldSpace(line[position])) {
+        ++position;
+    }
+    word = line.substr(start, position - start);
+    return !word.empty();
+}
+
+// Fields of a "track note duration [label]" line, viewing into the line
+struct NoteFields {
+    int track = 0;
+    std::string_view noteName;
+    int duration = 0;
+    std::string_view label;
+};
+
+// Trim the rest of a note line to its label: leading spaces and tabs, trailing
+// whitespace and carriage returns (Windows line endings)
+inline std::string_view trimLabel(std::string_view rest) {
+    std::size_t first = rest.find_first_not_of(" \t");
+    rest.remove_prefix(first == std::string_view::npos ? rest.size() : first);
+    std::size_t last = rest.find_last_not_of(" \t\r\n");
+    return rest.substr(0, last == std::string_view::npos ? 0 : last + 1);
+}
+
+// Parse a note line in place. Gives the same fields as reading it through an
+// istringstream and trimming the rest of the line as the label.
+inline bool parseNoteFields(std::string_view line, NoteFields& fields) {
+    std::size_t position = 0;
+    if (!parseIntField(line, position, fields.track) ||
+        !parseWordField(line, position, fields.noteName) ||
+        !parseIntField(line, position, fields.duration)) {
+        return false;
+    }
+    fields.label = trimLabel(line.substr(position));
+    return true;
+}
+
+// Structural index of a text chunk, in the style of simdjson's stage 1: the
+// offsets of every field start, field end and newline, found 64 bytes at a time
+struct StructuralIndex {
+    std::vector<std::uint32_t> positions;
+};
+
+// Whitespace and newline bits of one 64-byte block
+struct BlockMasks {
+    std::uint64_t whitespace;
+    std::uint64_t newlines;
+};
+
+inline int countTrailingZeros(std::uint64_t value) {
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return static_cast<int>(index);
+#elif defined(_MSC_VER)
+    unsigned long index;
+    if (_BitScanForward(&index, static_cast<unsigned long>(value))) {
+        return static_cast<int>(index);
+    }
+    _BitScanForward(&index, static_cast<unsigned long>(value >> 32));
+    return static_cast<int>(index) + 32;
+#else
+    return __builtin_ctzll(value);
+#endif
+}
+
+// Append the structural positions of one block. A field starts at a non-space
+// byte that follows a space and ends at a space that follows a non-space;
+// `previousWhitespace` carries the last bit of the block into the next one.
+inline std::uint32_t* emitStructural(BlockMasks masks, std::uint64_t validBits, std::uint64_t& previousWhitespace,
+                                     std::uint32_t base, std::uint32_t* out) {
+    std::uint64_t shifted = (masks.whitespace << 1) | previousWhitespace;
+    previousWhitespace = masks.whitespace >> 63;
+    std::uint64_t structural = ((~masks.whitespace & shifted) | (masks.whitespace & ~shifted) | masks.newlines) & validBits;
+    while (structural != 0) {
+        *out++ = base + static_cast<std::uint32_t>(countTrailingZeros(structural));
+        structural &= structural - 1;
+    }
+    return out;
+}
+
+BlockMasks classifyBlockScalar(const char* block) {
+    BlockMasks masks{0, 0};
+    for (int i = 0; i < 64; ++i) {
+        masks.whitespace |= static_cast<std::uint64_t>(isFieldSpace(block[i])) << i;
+        masks.newlines |= static_cast<std::uint64_t>(block[i] == '\n') << i;
+    }
+    return masks;
+}
+
+std::uint32_t* indexBlocksScalar(const char* text, std::size_t blocks, std::uint64_t& previousWhitespace,
+                                 std::uint32_t* out) {
+    for (std::size_t i = 0; i < blocks; ++i) {
+        out = emitStructural(classifyBlockScalar(text + i * 64), ~std::uint64_t{0}, previousWhitespace,
+                             static_cast<std::uint32_t>(i * 64), out);
+    }
+    return out;
+}
+
+#ifdef TURNS_HAVE_SSE2
+// Whitespace is ' ' or one of the contiguous control characters '\t'..'\r'
+inline BlockMasks classifyBlockSse2(const char* block) {
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i newline = _mm_set1_epi8('\n');
+    const __m128i belowTab = _mm_set1_epi8('\t' - 1);
+    const __m128i aboveReturn = _mm_set1_epi8('\r' + 1);
+    BlockMasks masks{0, 0};
+    for (int part = 0; part < 4; ++part) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + part * 16));
+        __m128i control = _mm_and_si128(_mm_cmpgt_epi8(bytes, belowTab), _mm_cmplt_epi8(bytes, aboveReturn));
+        __m128i whitespace = _mm_or_si128(control, _mm_cmpeq_epi8(bytes, space));
+        masks.whitespace |= static_cast<std::uint64_t>(static_cast<std::uint16_t>(_mm_movemask_epi8(whitespace))) << (part * 16);
+        masks.newlines |= static_cast<std::uint64_t>(static_cast<std::uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, newline)))) << (part * 16);
+    }
+    return masks;
+}
+
+std::uint32_t* indexBlocksSse2(const char* text, std::size_t blocks, std::uint64_t& previousWhitespace,
+                               std::uint32_t* out) {
+    for (std::size_t i = 0; i < blocks; ++i) {
+        out = emitStructural(classifyBlockSse2(text + i * 64), ~std::uint64_t{0}, previousWhitespace,
+                             static_cast<std::uint32_t>(i * 64), out);
+    }
+    return out;
+}
+#endif
+
+#ifdef TURNS_HAVE_X86
+TURNS_TARGET_AVX2 inline BlockMasks classifyBlockAvx2(const char* block) {
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i newline = _mm256_set1_epi8('\n');
+    const __m256i belowTab = _mm256_set1_epi8('\t' - 1);
+    const __m256i aboveReturn = _mm256_set1_epi8('\r' + 1);
+    BlockMasks masks{0, 0};
+    for (int part = 0; part < 2; ++part) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + part * 32));
+        __m256i control = _mm256_and_si256(_mm256_cmpgt_epi8(bytes, belowTab), _mm256_cmpgt_epi8(aboveReturn, bytes));
+        __m256i whitespace = _mm256_or_si256(control, _mm256_cmpeq_epi8(bytes, space));
+        masks.whitespace |= static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_epi8(whitespace))) << (part * 32);
+        masks.newlines |= static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, newline)))) << (part * 32);
+    }
+    return masks;
+}
+
+TURNS_TARGET_AVX2 std::uint32_t* indexBlocksAvx2(const char* text, std::size_t blocks, std::uint64_t& previousWhitespace,
+                                                 std::uint32_t* out) {
+    for (std::size_t i = 0; i < blocks; ++i) {
+        out = emitStructural(classifyBlockAvx2(text + i * 64), ~std::uint64_t{0}, previousWhitespace,
+                             static_cast<std::uint32_t>(i * 64), out);
+    }
+    return out;
+}
+#endif
+
+// Index a chunk that starts at the beginning of a line (chunks are below 4 GiB)
+void buildStructuralIndex(std::string_view text, StructuralIndex& index) {
+    static const bool useAvx2 = cpuSupportsAvx2();
+
+    index.positions.resize(text.size() + 1);
+    std::uint32_t* out = index.positions.data();
+    std::uint64_t previousWhitespace = 1;  // The chunk starts a new line
+    std::size_t blocks = text.size() / 64;
+#if defined(TURNS_HAVE_X86)
+    if (useAvx2) {
+        out = indexBlocksAvx2(text.data(), blocks, previousWhitespace, out);
+    } else {
+    #ifdef TURNS_HAVE_SSE2
+        out = indexBlocksSse2(text.data(), blocks, previousWhitespace, out);
+    #else
+        out = indexBlocksScalar(text.data(), blocks, previousWhitespace, out);
+    #endif
+    }
+#else
+    (void)useAvx2;
+    out = indexBlocksScalar(text.data(), blocks, previousWhitespace, out);
+#endif
+
+    // Pad the last partial block with spaces
+    std::size_t tail = text.size() - blocks * 64;
+    if (tail > 0) {
+        char block[64];
+        std::memset(block, ' ', sizeof(block));
+        std::memcpy(block, text.data() + blocks * 64, tail);
+        out = emitStructural(classifyBlockScalar(block), (std::uint64_t{1} << tail) - 1, previousWhitespace,
+                             static_cast<std::uint32_t>(blocks * 64), out);
+    }
+    index.positions.resize(out - index.positions.data());
+}
+
+// Input text is indexed in chunks of about this many bytes, cut at line ends
+constexpr std::size_t STRUCTURAL_CHUNK_BYTES = 1 << 20;
+
+// End of the chunk that starts at `start`: just past the first newline at or
+// after `start + chunkBytes - 1`, or the end of the text
+std::size_t chunkEndAtLine(std::string_view text, std::size_t start, std::size_t chunkBytes) {
+    std::size_t end = std::min(start + chunkBytes, text.size());
+    if (end < text.size()) {
+        const void* newline = std::memchr(text.data() + end - 1, '\n', text.size() - end + 1);
+        end = newline != nullptr ?
+            static_cast<std::size_t>(static_cast<const char*>(newline) - text.data()) + 1 : text.size();
+    }
+    return end;
+}
+
+// One line with the bounds of its first three fields, relative to the line start
+struct IndexedLine {
+    std::string_view text;
+    int fieldCount = 0;
+    std::uint32_t fieldStart[3] = {0, 0, 0};
+    std::uint32_t fieldEnd[3] = {0, 0, 0};
+};
+
+// Splits text into lines the way std::getline does ('\n' separated, a trailing
+// newline does not start another line), walking the structural index instead
+// of scanning bytes
+class StructuralLineReader {
+public:
+    explicit StructuralLineReader(std::string_view text) : text(text) {}
+
+    bool atEnd() const {
+        return lineStart >= text.size();
+    }
+
+    bool next(IndexedLine& line) {
+        if (atEnd()) {
+            return false;
+        }
+        if (lineStart >= chunkEnd) {
+            indexNextChunk();
+        }
+
+        std::uint32_t start = static_cast<std::uint32_t>(lineStart - chunkStart);
+        const char* chunk = text.data() + chunkStart;
+        line.fieldCount = 0;
+        bool inField = false;
+        while (cursor < index.positions.size()) {
+            std::uint32_t position = index.positions[cursor++];
+            char c = chunk[position];
+            if (!isFieldSpace(c)) {
+                if (line.fieldCount < 3) {
+                    line.fieldStart[line.fieldCount] = position - start;
+                }
+                inField = true;
+                continue;
+            }
+            if (inField) {
+                if (line.fieldCount < 3) {
+                    line.fieldEnd[line.fieldCount] = position - start;
+                }
+                ++line.fieldCount;
+                inField = false;
+            }
+            if (c == '\n') {
+                line.text = text.substr(lineStart, position - start);
+                lineStart = chunkStart + position + 1;
+                return true;
+            }
+        }
+
+        // Last line of the input, without a trailing newline
+        std::uint32_t end = static_cast<std::uint32_t>(chunkEnd - lineStart);
+        if (inField) {
+            if (line.fieldCount < 3) {
+                line.fieldEnd[line.fieldCount] = end;
+            }
+            ++line.fieldCount;
+        }
+        line.text = text.substr(lineStart, end);
+        lineStart = chunkEnd;
+        return true;
+    }
+
+private:
+    void indexNextChunk() {
+        chunkStart = lineStart;
+        chunkEnd = chunkEndAtLine(text, chunkStart, STRUCTURAL_CHUNK_BYTES);
+        buildStructuralIndex(text.substr(chunkStart, chunkEnd - chunkStart), index);
+        cursor = 0;
+    }
+
+    std::string_view text;
+    std::size_t chunkStart = 0;
+    std::size_t chunkEnd = 0;
+    std::size_t lineStart = 0;
+    StructuralIndex index;
+    std::size_t cursor = 0;
+};
+
+// Parse a note line from its indexed field bounds. Lines the fast path does not
+// cover - fewer than three fields, a sign or a number glued to the next field,
+// malformed lines - are settled by parseNoteFields.
+inline bool parseIndexedNoteFields(const IndexedLine& line, NoteFields& fields) {
+    if (line.fieldCount >= 3) {
+        const char* base = line.text.data();
+        auto track = std::from_chars(base + line.fieldStart[0], base + line.fieldEnd[0], fields.track);
+        auto duration = std::from_chars(base + line.fieldStart[2], base + line.fieldEnd[2], fields.duration);
+        if (track.ec == std::errc() && track.ptr == base + line.fieldEnd[0] &&
+            duration.ec == std::errc() && duration.ptr == base + line.fieldEnd[2]) {
+            fields.noteName = line.text.substr(line.fieldStart[1], line.fieldEnd[1] - line.fieldStart[1]);
+            fields.label = trimLabel(line.text.substr(line.fieldEnd[2]));
+            return true;
+        }
+    }
+    return parseNoteFields(line.text, fields);
+}
+
+// Number of input lines processFile parses before expanding and writing them
+constexpr std::size_t PROCESS_BLOCK_LINES = 4096;
+
+// What processFile writes for one input line
+enum class RowKind : std::uint8_t {
+    Verbatim,     // Malformed line, echoed unchanged
+    Plain,        // Label not eligible for transformation
+    Original,     // Eligible, but not selected for transformation
+    Transformed,  // Replaced by the segments of its turn
+    Dropped       // Transformation failed, nothing is written
+};
+
+// One parsed input line waiting for its block to be expanded and written
+struct PendingRow {
+    RowKind kind = RowKind::Verbatim;
+    std::string_view line;  // Views into the mapped input file
+    int track = 0;
+    std::string_view noteName;
+    int duration = 0;
+    std::string_view label;
+    LabelId labelId = UNKNOWN_LABEL;
+    VariantId variant = VariantId::Count;
+    std::uint32_t batchIndex = 0;
+};
+
+// Column widths of the processed output, left aligned and padded with spaces
+constexpr int TRACK_COLUMN_WIDTH = 11;
+constexpr int NOTE_COLUMN_WIDTH = 11;
+constexpr int DURATION_COLUMN_WIDTH = 20;
+constexpr int LABEL_COLUMN_WIDTH = 20;
+constexpr int VARIANT_COLUMN_WIDTH = 25;
+
+static_assert(NOTE_COLUMN_WIDTH >= NOTE_NAME_WIDTH, "note names are copied as whole slots");
+
+// Bytes the row formatter collects before writing them to the file
+constexpr std::size_t OUTPUT_FLUSH_BYTES = 1 << 20;
+
+// Formats fixed-width rows into a reusable buffer and writes it to the stream
+// in large blocks. Produces the same bytes as `std::left << std::setw(width)`:
+// values are padded on the right and never truncated. Without a stream the
+// formatter keeps everything, for chunks that are written out later.
+class RowFormatter {
+public:
+    explicit RowFormatter(std::ostream& output) : output(&output), buffer(OUTPUT_FLUSH_BYTES + 4096) {}
+
+    RowFormatter() : buffer(OUTPUT_FLUSH_BYTES) {}
+
+    ~RowFormatter() {
+        flush();
+    }
+
+    RowFormatter(const RowFormatter&) = delete;
+    RowFormatter& operator=(const RowFormatter&) = delete;
+
+    void text(std::string_view value) {
+        char* out = reserve(value.size());
+        std::memcpy(out, value.data(), value.size());
+        used += value.size();
+    }
+
+    void column(std::string_view value, int width) {
+        std::size_t padding = value.size() < static_cast<std::size_t>(width) ? width - value.size() : 0;
+        char* out = reserve(value.size() + padding);
+        std::memcpy(out, value.data(), value.size());
+        std::memset(out + value.size(), ' ', padding);
+        used += value.size() + padding;
+    }
+
+    void column(int value, int width) {
+        char digits[16];
+        char* end = digits + sizeof(digits);
+        char* start = end;
+        unsigned int magnitude = value < 0 ? 0u - static_cast<unsigned int>(value) : static_cast<unsigned int>(value);
+        do {
+            *--start = static_cast<char>('0' + magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude != 0);
+        if (value < 0) {
+            *--start = '-';
+        }
+        column(std::string_view(start, end - start), width);
+    }
+
+    // Note names are already padded to NOTE_NAME_WIDTH, so the slot is copied whole
+    void noteColumn(const NoteNameText& name, int width) {
+        char* out = reserve(width);
+        std::memcpy(out, name.text, NOTE_NAME_WIDTH);
+        std::memset(out + NOTE_NAME_WIDTH, ' ', width - NOTE_NAME_WIDTH);
+        used += width;
+    }
+
+    void endRow() {
+        *reserve(1) = '\n';
+        ++used;
+        if (used >= OUTPUT_FLUSH_BYTES) {
+            flush();
+        }
+    }
+
+    void flush() {
+        if (output != nullptr && used > 0) {
+            output->write(buffer.data(), static_cast<std::streamsize>(used));
+            used = 0;
+        }
+    }
+
+    // Take the formatted bytes of a formatter without a stream
+    std::vector<char> release() {
+        buffer.resize(used);
+        used = 0;
+        return std::move(buffer);
+    }
+
+private:
+    // Room for `count` more bytes; rows longer than the buffer grow it
+    char* reserve(std::size_t count) {
+        if (used + count > buffer.size()) {
+            flush();
+            if (used + count > buffer.size()) {
+                buffer.resize(std::max(used + count, buffer.size() * 2));
+            }
+        }
+        return buffer.data() + used;
+    }
+
+    std::ostream* output = nullptr;
+    std::vector<char> buffer;
+    std::size_t used = 0;
+};
+
+// Write the rows of one processed block, taking transformed notes from the batch
+void writeProcessedRows(RowFormatter& output, const PendingRow* rows, std::size_t count, const TurnBatch& batch) {
+    for (std::size_t i = 0; i < count; ++i) {
+        const PendingRow& row = rows[i];
+        switch (row.kind) {
+            case RowKind::Verbatim:
+                output.text(row.line);
+                output.endRow();
+                break;
+
+            case RowKind::Plain:
+            case RowKind::Original:
+                output.column(row.track, TRACK_COLUMN_WIDTH);
+                output.column(row.noteName, NOTE_COLUMN_WIDTH);
+                output.column(row.duration, DURATION_COLUMN_WIDTH);
+                output.column(row.label, LABEL_COLUMN_WIDTH);
+                // Empty variant column, or mark as original
+                output.column(row.kind == RowKind::Original ? "ORIGINAL" : "", VARIANT_COLUMN_WIDTH);
+                output.endRow();
+                break;
+
+            case RowKind::Transformed: {
+                std::string_view selectedName = variantName(row.variant);
+                const Segment* first = batch.segments.data() + batch.offsets[row.batchIndex];
+                const Segment* last = batch.segments.data() + batch.offsets[row.batchIndex + 1];
+                for (const Segment* segment = first; segment != last; ++segment) {
+                    output.column(row.track, TRACK_COLUMN_WIDTH);
+                    output.noteColumn(noteNameText(segment->pitch), NOTE_COLUMN_WIDTH);
+                    output.column(segment->duration, DURATION_COLUMN_WIDTH);
+                    output.column(row.label, LABEL_COLUMN_WIDTH);
+                    output.column(selectedName, VARIANT_COLUMN_WIDTH);
+                    output.endRow();
+                }
+                break;
+            }
+
+            case RowKind::Dropped:
+                break;
+        }
+    }
+}
+
+// Collect the MIDI notes of one processed block: the same notes convertToMidi
+// reads back from the rows writeProcessedRows formats, without the text
+void collectMidiNotes(const PendingRow* rows, std::size_t count, const TurnBatch& batch,
+                      std::vector<MidiNote>& notes, std::string& errors) {
+    for (std::size_t i = 0; i < count; ++i) {
+        const PendingRow& row = rows[i];
+        if (row.kind == RowKind::Verbatim || row.kind == RowKind::Dropped) {
+            continue;
+        }
+
+        // convertToMidi skips rows starting with '-' and analyzer lines
+        if (row.track < 0 || row.label.find("MIDI File Analyzed") != std::string_view::npos) {
+            continue;
+        }
+
+        if (row.kind == RowKind::Transformed) {
+            const Segment* first = batch.segments.data() + batch.offsets[row.batchIndex];
+            const Segment* last = batch.segments.data() + batch.offsets[row.batchIndex + 1];
+            std::uint8_t variant = static_cast<std::uint8_t>(row.variant);
+            for (const Segment* segment = first; segment != last; ++segment) {
+                notes.push_back(MidiNote{row.track, segment->pitch, segment->duration, row.label, variant});
+            }
+            continue;
+        }
+
+        // Skip header or non-note lines
+        if (row.noteName == "Note" || row.noteName == "Track") {
+            continue;
+        }
+        int noteNumber = 0;
+        NoteParseError noteError = parseNoteName(row.noteName, noteNumber);
+        if (noteError != NoteParseError::None) {
+            errors += "Error processing note '" + std::string(row.noteName) + "': " +
+                      noteParseErrorMessage(noteError, row.noteName) + "\n";
+            continue;
+        }
+        std::uint8_t variant = row.kind == RowKind::Original ? ORIGINAL_NOTE_VARIANT : PLAIN_NOTE_VARIANT;
+        notes.push_back(MidiNote{row.track, noteNumber, row.duration, row.label, variant});
+    }
+}
+
+// Settings shared by every chunk of one processFile run, read-only while processing
+struct ProcessSettings {
+    const LabelDictionary* labels = nullptr;
+    const std::vector<std::string>* selectedVariants = nullptr;
+    std::vector<VariantId> selectedVariantIds;
+    bool useRandomVariant = true;
+    std::uint32_t variantChoices = VARIANT_COUNT;
+    TransformChance transformChance;
+    std::uint64_t randomSeed = 0;
+};
+
+// Statistics and error messages of processed input, merged in input order
+struct ChunkStatistics {
+    int totalEligibleNotes = 0;
+    int transformedNotes = 0;
+    std::array<int, VARIANT_COUNT> variantUsage{};
+    std::string errors;
+    std::string midiErrors;  // Notes that cannot go into the MIDI file
+
+    void merge(const ChunkStatistics& other) {
+        totalEligibleNotes += other.totalEligibleNotes;
+        transformedNotes += other.transformedNotes;
+        for (int i = 0; i < VARIANT_COUNT; ++i) {
+            variantUsage[i] += other.variantUsage[i];
+        }
+        errors += other.errors;
+        midiErrors += other.midiErrors;
+    }
+};
+
+// Transform the lines of `text`, format them into `formatter` and collect their
+// notes into `midiNotes`; either output may be null. `firstLine` is the index
+// of the first line of `text` in the whole input, which keys the per-line randomness.
+void processChunk(std::string_view text, std::uint64_t firstLine, const ProcessSettings& settings,
+                  RowFormatter* formatter, ChunkStatistics& statistics, std::vector<MidiNote>* midiNotes) {
+    const LabelDictionary& labels = *settings.labels;
+
+    // Lines are handled in blocks: parse and pick variants line by line, then
+    // expand all transformed notes of the block with one expandTurnsBatch call
+    std::vector<PendingRow> rows(PROCESS_BLOCK_LINES);
+    std::size_t rowCount = 0;
+    std::vector<int> batchPitches;
+    std::vector<int> batchDurations;
+    std::vector<VariantId> batchVariants;
+    std::vector<TimeMeter> batchMeters;
+    TurnBatch batch;
+
+    StructuralLineReader reader(text);
+    IndexedLine line;
+    NoteFields fields;
+    std::uint64_t lineIndex = firstLine;
+    while (reader.next(line)) {
+        PendingRow& row = rows[rowCount++];
+        std::uint64_t currentLine = lineIndex++;
+
+        // Parse line with Note in string format (e.g., "C4"); the label is trimmed
+        if (!parseIndexedNoteFields(line, fields)) {
+            row.kind = RowKind::Verbatim;  // Handle malformed lines
+            row.line = line.text;
+        } else {
+            row.track = fields.track;
+            row.noteName = fields.noteName;
+            row.duration = fields.duration;
+            row.label = fields.label;
+            row.labelId = findLabelId(labels, row.label);
+
+            // Check if this label is eligible for transformation
+            if (labelIsEligible(labels, row.labelId)) {
+
+                statistics.totalEligibleNotes++;
+
+                // Check if this note should be transformed based on percentage
+                LineDraws draws = drawForLine(settings.randomSeed, row.track, currentLine);
+                if (settings.transformChance.accepts(draws.transform)) {
+                    statistics.transformedNotes++;
+                    row.kind = RowKind::Dropped;
+
+                    // Convert note name to MIDI number; the row of an invalid name stays dropped
+                    int noteIndex = 0;
+                    NoteParseError noteError = parseNoteName(row.noteName, noteIndex);
+                    if (noteError != NoteParseError::None) {
+                        statistics.errors += "Error processing note '" + std::string(row.noteName) + "': " +
+                                             noteParseErrorMessage(noteError, row.noteName) + "\n";
+                    } else {
+                        try {
+                            // Randomly select a variant from the user's choices
+                            VariantId selectedVariant;
+                            if (settings.useRandomVariant) {
+                                // Use a random variant from the complete catalog (variantChoices is VARIANT_COUNT)
+                                selectedVariant = static_cast<VariantId>(
+                                    reduceToRange(draws.variant, settings.variantChoices));
+                            } else {
+                                // Use one of the user's selected variants randomly
+                                size_t choice = reduceToRange(draws.variant, settings.variantChoices);
+                                selectedVariant = settings.selectedVariantIds[choice];
+                                if (selectedVariant == VariantId::Count) {
+                                    throw std::invalid_argument("Unknown turn variant: " + (*settings.selectedVariants)[choice]);
+                                }
+                            }
+                            validateTurnArguments(row.duration, DUPLE);
+                            if (!turnStaysInMidiRange(noteIndex, DUPLE, selectedVariant)) {
+                                // Keep the note unchanged when its turn would leave the MIDI pitch range
+                                statistics.transformedNotes--;
+                                row.kind = RowKind::Original;
+                                statistics.errors += "Error processing note '" + std::string(row.noteName) + "': Turn variant " +
+                                                     std::string(variantName(selectedVariant)) +
+                                                     " goes outside the MIDI pitch range, note kept\n";
+                            } else {
+                                // Queue the note for the block's turn expansion
+                                row.kind = RowKind::Transformed;
+                                row.variant = selectedVariant;
+                                row.batchIndex = static_cast<std::uint32_t>(batchPitches.size());
+                                batchPitches.push_back(noteIndex);
+                                batchDurations.push_back(row.duration);
+                                batchVariants.push_back(selectedVariant);
+                                batchMeters.push_back(DUPLE);
+
+                                // Track variant usage
+                                statistics.variantUsage[static_cast<int>(selectedVariant)]++;
+                            }
+                        } catch (const std::exception& e) {
+                            // Handle turns that cannot be applied
+                            statistics.errors += "Error processing note '" + std::string(row.noteName) + "': " + e.what() + "\n";
+                        }
+                    }
+                } else {
+                    // Output original data for notes not selected for transformation
+                    row.kind = RowKind::Original;
+                }
+            } else {
+                // Output original data for non-eligible labels
+                row.kind = RowKind::Plain;
+            }
+        }
+
+        if (rowCount == rows.size() || reader.atEnd()) {
+            // Apply turn transformation to every queued note of the block
+            expandTurnsBatch(batchPitches.data(), batchDurations.data(), batchVariants.data(),
+                             batchMeters.data(), batchPitches.size(), batch);
+            if (formatter != nullptr) {
+                writeProcessedRows(*formatter, rows.data(), rowCount, batch);
+            }
+            if (midiNotes != nullptr) {
+                collectMidiNotes(rows.data(), rowCount, batch, *midiNotes, statistics.midiErrors);
+            }
+
+            rowCount = 0;
+            batchPitches.clear();
+            batchDurations.clear();
+            batchVariants.clear();
+            batchMeters.clear();
+        }
+    }
+}
+
+// Input is split into chunks of about this many bytes for multithreaded processing
+constexpr std::size_t PARALLEL_CHUNK_BYTES = 4 << 20;
+
+// Bounded multi-producer multi-consumer ring buffer (Dmitry Vyukov's design):
+// every cell carries a sequence number, so producers and consumers only
+// contend on one atomic position each and never take a lock. tryPush and
+// tryPop fail instead of blocking; the pipeline stages decide how to wait.
+template <typename T>
+class BoundedQueue {
+public:
+    // `capacity` must be a power of two
+    explicit BoundedQueue(std::size_t capacity) : cells(new Cell[capacity]), mask(capacity - 1) {
+        for (std::size_t i = 0; i < capacity; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool tryPush(T& value) {
+        std::size_t position = enqueuePosition.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[position & mask];
+            std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+            if (difference == 0) {
+                if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) {
+                return false;  // Full
+            } else {
+                position = enqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(T& value) {
+        std::size_t position = dequeuePosition.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[position & mask];
+            std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t difference = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position + 1);
+            if (difference == 0) {
+                if (dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    value = std::move(cell.value);
+                    cell.sequence.store(position + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) {
+                return false;  // Empty
+            } else {
+                position = dequeuePosition.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Number of queued items; only a snapshot while other threads are running
+    std::size_t depth() const {
+        std::size_t enqueued = enqueuePosition.load(std::memory_order_relaxed);
+        std::size_t dequeued = dequeuePosition.load(std::memory_order_relaxed);
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+private:
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    std::size_t mask;
+    alignas(64) std::atomic<std::size_t> enqueuePosition{0};
+    alignas(64) std::atomic<std::size_t> dequeuePosition{0};
+};
+
+// Counters for tuning the processFile pipeline. A stall is one wait of a stage
+// on its neighbour, however long it lasted.
+struct PipelineStatistics {
+    std::atomic<std::uint64_t> readerStalls{0};        // Input queue full, or too far ahead of the writer
+    std::atomic<std::uint64_t> workerInputStalls{0};   // Input queue empty
+    std::atomic<std::uint64_t> workerOutputStalls{0};  // Output queue full
+    std::atomic<std::uint64_t> writerStalls{0};        // Next chunk in order not finished yet
+    std::uint64_t inputDepthTotal = 0;                 // Sampled by the reader before each push
+    std::uint64_t inputDepthMax = 0;
+    std::uint64_t inputSamples = 0;
+    std::uint64_t outputDepthTotal = 0;                // Sampled by the writer before each pop
+    std::uint64_t outputDepthMax = 0;
+    std::uint64_t outputSamples = 0;
+};
+
+// Wait until `ready` holds, counting the wait as one stall. Short waits yield;
+// long ones (slow disks) back off to sleeping so idle stages do not burn a core.
+template <typename Ready>
+void waitForStage(Ready ready, std::atomic<std::uint64_t>& stalls) {
+    if (ready()) {
+        return;
+    }
+    stalls.fetch_add(1, std::memory_order_relaxed);
+    for (int spins = 0; !ready(); ++spins) {
+        if (spins < 64) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+}
+
+// A chunk of input handed from the reader to the transform workers
+struct ChunkTask {
+    std::size_t index = 0;
+    std::string_view text;
+    std::uint64_t firstLine = 0;
+    bool last = false;  // No more chunks; the worker stops
+};
+
+// A transformed chunk handed from a worker to the writer
+struct ChunkOutput {
+    std::size_t index = 0;
+    std::vector<char> bytes;
+    std::vector<MidiNote> midiNotes;
+    ChunkStatistics statistics;
+};
+
+// Receives the MIDI notes of each chunk, in input order
+using MidiNoteSink = std::function<void(const std::vector<MidiNote>&)>;
+
+// Queue capacities and the writer's reorder window, in chunks per worker
+constexpr std::size_t PIPELINE_QUEUE_CHUNKS_PER_WORKER = 2;
+
+// Run processFile as three concurrent stages:
+//  - a reader that cuts the input into chunks at line ends and counts their
+//    lines, which also pages the mapped file in from disk,
+//  - `threadCount` workers that transform and format chunks,
+//  - the calling thread as writer, which restores input order, writes the
+//    text to `output` and passes the notes to `notes` (either may be null).
+// The reader never gets more than a window of chunks ahead of the writer, so
+// memory use stays bounded however slow the output is.
+void runProcessPipeline(std::string_view text, const ProcessSettings& settings, unsigned int threadCount,
+                        std::ostream* output, const MidiNoteSink* notes, ChunkStatistics& statistics,
+                        PipelineStatistics& pipeline) {
+    std::size_t capacity = 1;
+    while (capacity < threadCount * PIPELINE_QUEUE_CHUNKS_PER_WORKER) {
+        capacity *= 2;
+    }
+    const std::size_t window = 2 * capacity;
+    BoundedQueue<ChunkTask> tasks(capacity);
+    BoundedQueue<ChunkOutput> outputs(capacity);
+    std::atomic<std::size_t> writtenChunks{0};
+    std::atomic<std::size_t> chunkCount{SIZE_MAX};
+
+    std::thread reader([&] {
+        std::size_t index = 0;
+        std::uint64_t firstLine = 0;
+        for (std::size_t start = 0; start < text.size(); ++index) {
+            std::size_t end = chunkEndAtLine(text, start, PARALLEL_CHUNK_BYTES);
+            ChunkTask task{index, text.substr(start, end - start), firstLine, false};
+            firstLine += std::count(task.text.begin(), task.text.end(), '\n');
+            start = end;
+
+            waitForStage([&] { return index < writtenChunks.load(std::memory_order_acquire) + window; },
+                         pipeline.readerStalls);
+            std::uint64_t depth = tasks.depth();
+            pipeline.inputDepthTotal += depth;
+            pipeline.inputDepthMax = std::max(pipeline.inputDepthMax, depth);
+            ++pipeline.inputSamples;
+            waitForStage([&] { return tasks.tryPush(task); }, pipeline.readerStalls);
+        }
+        chunkCount.store(index, std::memory_order_release);
+        for (unsigned int t = 0; t < threadCount; ++t) {
+            ChunkTask stop;
+            stop.last = true;
+            waitForStage([&] { return tasks.tryPush(stop); }, pipeline.readerStalls);
+        }
+    });
+
+    std::vector<std::thread> workers;
+    for (unsigned int t = 0; t < threadCount; ++t) {
+        workers.emplace_back([&] {
+            for (;;) {
+                ChunkTask task;
+                waitForStage([&] { return tasks.tryPop(task); }, pipeline.workerInputStalls);
+                if (task.last) {
+                    return;
+                }
+                ChunkOutput result;
+                result.index = task.index;
+                RowFormatter formatter;
+                processChunk(task.text, task.firstLine, settings, output != nullptr ? &formatter : nullptr,
+                             result.statistics, notes != nullptr ? &result.midiNotes : nullptr);
+                result.bytes = formatter.release();
+                waitForStage([&] { return outputs.tryPush(result); }, pipeline.workerOutputStalls);
+            }
+        });
+    }
+
+    // Writer: finished chunks wait in the reorder window until their turn
+    std::vector<ChunkOutput> pending(window);
+    std::vector<char> arrived(window, 0);
+    for (std::size_t next = 0; next != chunkCount.load(std::memory_order_acquire);) {
+        std::size_t slot = next % window;
+        if (arrived[slot]) {
+            if (output != nullptr) {
+                output->write(pending[slot].bytes.data(), static_cast<std::streamsize>(pending[slot].bytes.size()));
+            }
+            if (notes != nullptr) {
+                (*notes)(pending[slot].midiNotes);
+            }
+            statistics.merge(pending[slot].statistics);
+            pending[slot] = ChunkOutput();
+            arrived[slot] = 0;
+            writtenChunks.store(++next, std::memory_order_release);
+            continue;
+        }
+
+        ChunkOutput result;
+        bool popped = false;
+        std::uint64_t depth = outputs.depth();
+        pipeline.outputDepthTotal += depth;
+        pipeline.outputDepthMax = std::max(pipeline.outputDepthMax, depth);
+        ++pipeline.outputSamples;
+        waitForStage([&] {
+            popped = outputs.tryPop(result);
+            return popped || next == chunkCount.load(std::memory_order_acquire);
+        }, pipeline.writerStalls);
+        if (popped) {
+            std::size_t resultSlot = result.index % window;
+            pending[resultSlot] = std::move(result);
+            arrived[resultSlot] = 1;
+        }
+    }
+
+    reader.join();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+// Summary of the pipeline counters for AppState::pipelineReport
+std::string describePipeline(const PipelineStatistics& pipeline, unsigned int threadCount) {
+    auto average = [](std::uint64_t total, std::uint64_t samples) {
+        return samples > 0 ? static_cast<double>(total) / samples : 0.0;
+    };
+    std::stringstream report;
+    report << std::fixed << std::setprecision(1)
+           << "Pipeline (" << threadCount << " workers):\n"
+           << "  Input queue depth: average " << average(pipeline.inputDepthTotal, pipeline.inputSamples)
+           << ", max " << pipeline.inputDepthMax << "\n"
+           << "  Output queue depth: average " << average(pipeline.outputDepthTotal, pipeline.outputSamples)
+           << ", max " << pipeline.outputDepthMax << "\n"
+           << "  Reader stalls: " << pipeline.readerStalls.load() << "\n"
+           << "  Worker stalls: " << pipeline.workerInputStalls.load() << " waiting for input, "
+           << pipeline.workerOutputStalls.load() << " waiting for the writer\n"
+           << "  Writer stalls: " << pipeline.writerStalls.load() << "\n";
+    return report.str();
+}
+
+// Largest variable-length quantity of a 32-bit value; MIDI files only use up to 4 bytes
+constexpr std::size_t MAX_VLQ_BYTES = 5;
+
+// Bytes of `value` as a MIDI variable-length quantity
+inline std::size_t vlqLength(std::uint32_t value) {
+    std::size_t count = 1;
+    while (count < MAX_VLQ_BYTES && (value >> (7 * count)) != 0) {
+        ++count;
+    }
+    return count;
+}
+
+// Encode `value` as a MIDI variable-length quantity: 7 bits per byte, most
+// significant first, with the high bit set on all but the last byte
+inline std::size_t encodeVlq(std::uint32_t value, unsigned char* out) {
+    std::size_t count = vlqLength(value);
+    for (std::size_t i = count; i-- > 0;) {
+        out[i] = static_cast<unsigned char>((value & 0x7F) | (i + 1 < count ? 0x80 : 0));
+        value >>= 7;
+    }
+    return count;
+}
+
+inline void storeBigEndian32(std::uint32_t value, unsigned char* out) {
+    out[0] = static_cast<unsigned char>(value >> 24);
+    out[1] = static_cast<unsigned char>(value >> 16);
+    out[2] = static_cast<unsigned char>(value >> 8);
+    out[3] = static_cast<unsigned char>(value);
+}
+
+// Outputs for encodeMidiTrack: one only counts the bytes, so every chunk's
+// exact length is known before any of them is written
+struct MidiByteCounter {
+    std::size_t size = 0;
+
+    void vlq(std::uint32_t value) { size += vlqLength(value); }
+    void byte(unsigned char) { ++size; }
+};
+
+struct MidiByteWriter {
+    unsigned char* out;
+
+    void vlq(std::uint32_t value) { out += encodeVlq(value, out); }
+    void byte(unsigned char value) { *out++ = value; }
+};
+
+// Time order of the events of one track: note-offs go before note-ons at the
+// same tick, then lower pitches first. Events that tie on all of it are
+// identical, so every sort and merge writes the same file.
+struct MidiEventBefore {
+    bool operator()(const MidiEvent& a, const MidiEvent& b) const {
+        return a.sortKey() < b.sortKey();
+    }
+};
+
+// The events of a track in time order; only needed for tracks that are not sequential
+void sortTrackEvents(const MidiTrack& track, std::vector<MidiEvent>& sortedEvents) {
+    // Notes without a positive duration overlap their neighbours: sort all events by time
+    sortedEvents.clear();
+    sortedEvents.reserve(2 * track.noteCount);
+    for (std::size_t n = 0; n < track.noteCount; ++n) {
+        const MidiEvent& noteOn = track.noteOns[n];
+        sortedEvents.push_back(noteOn);
+        sortedEvents.push_back(MidiEvent(track.noteEnd(n), noteOn.noteNumber(), false, 0));
+    }
+    std::sort(sortedEvents.begin(), sortedEvents.end(), MidiEventBefore());
+}
+
+// Encodes the body of one MTrk chunk, event by event in time order. With
+// `compact`, note-offs are note-ons with velocity 0 and repeated status bytes
+// are left out (running status), so all note events after the first take 2
+// bytes plus their delta time.
+template <typename Output>
+class MidiTrackEncoder {
+public:
+    MidiTrackEncoder(Output& output, bool compact) : output(output), compact(compact) {
+        // Set instrument (program change) - using piano (0) as default
+        output.byte(0x00);  // Delta time
+        output.byte(0xC0);  // Program change, channel 0
+        output.byte(0x00);  // Program number
+    }
+
+    void event(std::int64_t time, int noteNumber, bool isNoteOn, int velocity) {
+        // Delta time (variable length); negative durations give negative
+        // start times, whose deltas are written as 0
+        std::int64_t deltaTime = time - lastTime;
+        lastTime = time;
+        output.vlq(deltaTime > 0 ? static_cast<std::uint32_t>(std::min<std::int64_t>(deltaTime, UINT32_MAX)) : 0u);
+
+        if (compact) {
+            // Note on: 0x90 | channel, sent only when the status changes, then note, velocity
+            if (runningStatus != 0x90) {
+                output.byte(0x90);
+                runningStatus = 0x90;
+            }
+            output.byte(static_cast<unsigned char>(noteNumber));
+            output.byte(isNoteOn ? static_cast<unsigned char>(velocity) : 0x00);  // Velocity 0 ends the note
+        } else if (isNoteOn) {
+            // Note on: 0x90 | channel, note, velocity
+            output.byte(0x90);
+            output.byte(static_cast<unsigned char>(noteNumber));
+            output.byte(static_cast<unsigned char>(velocity));
+        } else {
+            // Note off: 0x80 | channel, note, velocity
+            output.byte(0x80);
+            output.byte(static_cast<unsigned char>(noteNumber));
+            output.byte(0x00);  // Velocity (0)
+        }
+    }
+
+    void event(const MidiEvent& event) {
+        this->event(event.tick(), event.noteNumber(), event.isNoteOn(), event.velocity());
+    }
+
+    void finish() {
+        // End of track: delta time, meta event, end of track, length
+        output.byte(0x00);
+        output.byte(0xFF);
+        output.byte(0x2F);
+        output.byte(0x00);
+    }
+
+private:
+    Output& output;
+    bool compact;
+    std::int64_t lastTime = 0;
+    unsigned char runningStatus = 0xC0;
+};
+
+// Encode the body of one MTrk chunk
+template <typename Output>
+void encodeMidiTrack(Output& output, const MidiTrack& track, const std::vector<MidiEvent>& sortedEvents,
+                     bool compact) {
+    MidiTrackEncoder<Output> encoder(output, compact);
+    if (track.sequential) {
+        // Each note ends exactly when the next one starts, and note-offs go
+        // before note-ons at the same time, so the events are already in order
+        for (std::size_t n = 0; n < track.noteCount; ++n) {
+            const MidiEvent& noteOn = track.noteOns[n];
+            encoder.event(noteOn.tick(), noteOn.noteNumber(), true, noteOn.velocity());
+            encoder.event(track.noteEnd(n), noteOn.noteNumber(), false, 0);
+        }
+    } else {
+        for (const MidiEvent& event : sortedEvents) {
+            encoder.event(event);
+        }
+    }
+    encoder.finish();
+}
+
+// Exact size of the body encodeMidiTrack writes for a track
+std::size_t midiTrackBytes(const MidiTrack& track, const std::vector<MidiEvent>& sortedEvents, bool compact) {
+    if (!track.sequential) {
+        MidiByteCounter counter;
+        encodeMidiTrack(counter, track, sortedEvents, compact);
+        return counter.size;
+    }
+
+    // In a sequential track every note-on has delta 0 and its note-off the duration
+    std::size_t noteCount = track.noteCount;
+    std::size_t size = 3 + 4;  // Program change, end of track
+    if (compact) {
+        size += noteCount * 2 * 2 + (noteCount > 0 ? 1 : 0);
+    } else {
+        size += noteCount * 2 * 3;
+    }
+    for (std::size_t n = 0; n < noteCount; ++n) {
+        std::int64_t duration = track.noteEnd(n) - track.noteOns[n].tick();
+        size += 1 + vlqLength(static_cast<std::uint32_t>(std::min<std::int64_t>(duration, UINT32_MAX)));
+    }
+    return size;
+}
+
+// Worker threads for a setting like AppState::threadCount, where 0 means one per core
+unsigned int resolveThreadCount(int requested) {
+    return requested > 0 ? static_cast<unsigned int>(requested) :
+        std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Run work(i, worker) for every i below `count` on `threadCount` threads, the
+// calling thread included as worker 0; each thread takes the next index when it is done
+template <typename Work>
+void parallelFor(std::size_t count, unsigned int threadCount, const Work& work) {
+    std::atomic<std::size_t> next{0};
+    auto run = [&](unsigned int worker) {
+        for (std::size_t i = next.fetch_add(1); i < count; i = next.fetch_add(1)) {
+            work(i, worker);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned int t = 1; t < threadCount; ++t) {
+        threads.emplace_back(run, t);
+    }
+    run(0);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+// An output file written at explicit offsets, so that several threads can
+// write their parts at the same time
+class PositionalFile {
+public:
+    explicit PositionalFile(const std::string& path) {
+#if defined(_WIN32) || defined(_WIN64)
+        file = CreateFileA(path.c_str(), GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+#else
+        descriptor = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+    }
+
+    ~PositionalFile() {
+#if defined(_WIN32) || defined(_WIN64)
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+#else
+        if (descriptor >= 0) {
+            close(descriptor);
+        }
+#endif
+    }
+
+    PositionalFile(const PositionalFile&) = delete;
+    PositionalFile& operator=(const PositionalFile&) = delete;
+
+    bool isOpen() const {
+#if defined(_WIN32) || defined(_WIN64)
+        return file != INVALID_HANDLE_VALUE;
+#else
+        return descriptor >= 0;
+#endif
+    }
+
+    // Write all of `data` at `offset`; safe to call from several threads
+    bool writeAt(std::uint64_t offset, const unsigned char* data, std::size_t size) {
+        while (size > 0) {
+            std::size_t part = std::min<std::size_t>(size, 1 << 30);
+#if defined(_WIN32) || defined(_WIN64)
+            OVERLAPPED position{};
+            position.Offset = static_cast<DWORD>(offset);
+            position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+            DWORD written = 0;
+            if (!WriteFile(file, data, static_cast<DWORD>(part), &written, &position) || written == 0) {
+                return false;
+            }
+#else
+            ssize_t written = pwrite(descriptor, data, part, static_cast<off_t>(offset));
+            if (written < 0 && errno == EINTR) {
+                continue;
+            }
+            if (written <= 0) {
+                return false;
+            }
+#endif
+            data += written;
+            size -= static_cast<std::size_t>(written);
+            offset += static_cast<std::uint64_t>(written);
+        }
+        return true;
+    }
+
+private:
+#if defined(_WIN32) || defined(_WIN64)
+    HANDLE file = INVALID_HANDLE_VALUE;
+#else
+    int descriptor = -1;
+#endif
+};
+
+// Size of the MThd chunk; the track chunks follow it
+constexpr std::size_t MIDI_HEADER_BYTES = 14;
+
+bool writeMidiHeader(PositionalFile& midiFile, std::size_t trackCount) {
+    // Format: MThd + <length> + <format> + <tracks> + <division>
+    int numTracks = static_cast<int>(trackCount);
+    const unsigned char header[MIDI_HEADER_BYTES] = {
+        'M', 'T', 'h', 'd',  // Chunk type
+        0, 0, 0, 6,          // Header length (always 6 bytes)
+        0, 1,                // Format (0 = single track, 1 = multiple tracks, same timebase)
+        static_cast<unsigned char>((numTracks >> 8) & 0xFF), static_cast<unsigned char>(numTracks & 0xFF),
+        0x04, 0x00           // Division (ticks per quarter note = 1024) in big-endian
+    };
+    return midiFile.writeAt(0, header, sizeof(header));
+}
+
+// Write the collected events as a format 1 MIDI file. Tracks are encoded in
+// parallel on AppState::threadCount workers: a first pass sizes every MTrk
+// chunk exactly, which fixes its offset in the file, and the second encodes
+// the chunks, largest first, and writes each at its offset.
+void writeMidiFile(const std::string& outputFile, const MidiEventBuilder& midi, AppState& state) {
+    PositionalFile midiFile(outputFile);
+    if (!midiFile.isOpen()) {
+        state.statusMessage += "Error opening output MIDI file: " + outputFile + "\n";
+        return;
+    }
+
+    std::vector<const MidiTrack*> tracks;
+    for (const MidiTrack& track : midi.trackList()) {
+        tracks.push_back(&track);
+    }
+    unsigned int threadCount = static_cast<unsigned int>(
+        std::min<std::size_t>(resolveThreadCount(state.threadCount), std::max<std::size_t>(tracks.size(), 1)));
+
+    // Size every chunk; overlapping tracks are sorted once here and kept for encoding
+    std::vector<std::vector<MidiEvent>> sortedEvents(tracks.size());
+    std::vector<std::size_t> chunkBytes(tracks.size());
+    parallelFor(tracks.size(), threadCount, [&](std::size_t i, unsigned int) {
+        if (!tracks[i]->sequential) {
+            sortTrackEvents(*tracks[i], sortedEvents[i]);
+        }
+        chunkBytes[i] = 8 + midiTrackBytes(*tracks[i], sortedEvents[i], state.compactMidi);
+    });
+
+    std::atomic<bool> writeFailed{!writeMidiHeader(midiFile, tracks.size())};
+
+    // Chunks follow the header in track order
+    std::vector<std::uint64_t> chunkOffsets(tracks.size());
+    std::uint64_t offset = MIDI_HEADER_BYTES;
+    for (std::size_t i = 0; i < tracks.size(); ++i) {
+        chunkOffsets[i] = offset;
+        offset += chunkBytes[i];
+    }
+
+    // Encode and write each track, the largest first so the threads finish together
+    std::vector<std::size_t> order(tracks.size());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&](std::size_t a, std::size_t b) { return chunkBytes[a] > chunkBytes[b]; });
+    // One reusable buffer per worker; the first chunk a worker takes is its largest
+    std::vector<std::unique_ptr<unsigned char[]>> buffers(threadCount);
+    parallelFor(tracks.size(), threadCount, [&](std::size_t n, unsigned int worker) {
+        std::size_t i = order[n];
+        if (!buffers[worker]) {
+            buffers[worker].reset(new unsigned char[chunkBytes[i]]);
+        }
+        unsigned char* buffer = buffers[worker].get();
+        MidiByteWriter writer{buffer + 8};
+        encodeMidiTrack(writer, *tracks[i], sortedEvents[i], state.compactMidi);
+
+        // Track header with the length from the first pass
+        std::memcpy(buffer, "MTrk", 4);
+        storeBigEndian32(static_cast<std::uint32_t>(chunkBytes[i] - 8), buffer + 4);
+        if (!midiFile.writeAt(chunkOffsets[i], buffer, chunkBytes[i])) {
+            writeFailed = true;
+        }
+        std::vector<MidiEvent>().swap(sortedEvents[i]);
+    });
+
+    if (writeFailed) {
+        state.statusMessage += "Error writing MIDI file: " + outputFile + "\n";
+        return;
+    }
+    state.statusMessage += "MIDI file created successfully: " + outputFile + "\n";
+}
+
+// convertToMidi with AppState::memoryBudget set keeps only a bounded part of
+// the events in memory and moves the rest to a spill file. The budget is
+// split, in bytes of events:
+//  - a quarter for the note-ons still in memory (their vectors may double),
+//  - a quarter for sorting the events of an overlapping track in runs,
+//  - a sixteenth each for reading note-ons and for merging sorted runs,
+//  - an eighth for the output buffer.
+struct SpillBudget {
+    std::size_t pendingEvents;
+    std::size_t sortEvents;
+    std::size_t readEvents;
+    std::size_t mergeEvents;
+    std::size_t outputBytes;
+
+    explicit SpillBudget(std::size_t budgetBytes)
+        : pendingEvents(budgetEvents(budgetBytes / 4)),
+          sortEvents(budgetEvents(budgetBytes / 4)),
+          readEvents(budgetEvents(budgetBytes / 16)),
+          mergeEvents(budgetEvents(budgetBytes / 16)),
+          outputBytes(std::max<std::size_t>(budgetBytes / 8, 4096)) {}
+
+    static std::size_t budgetEvents(std::size_t bytes) {
+        return std::max<std::size_t>(bytes / sizeof(MidiEvent), MIN_SPILL_READ_EVENTS);
+    }
+
+    // Smallest read buffer of one run while merging
+    static constexpr std::size_t MIN_SPILL_READ_EVENTS = 512;
+};
+
+// A run of packed events in the spill file
+struct SpillRun {
+    std::uint64_t offset = 0;
+    std::size_t count = 0;
+};
+
+// Temporary file of spilled event runs in the system temp directory, removed
+// again when done. Throws std::runtime_error when it cannot be used.
+class SpillFile {
+public:
+    SpillFile() {
+        std::random_device random;
+        std::stringstream name;
+        name << "turns-spill-" << std::hex << random() << random() << ".tmp";
+        path = std::filesystem::temp_directory_path() / name.str();
+        file.open(path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            throw std::runtime_error("cannot create " + path.string());
+        }
+    }
+
+    ~SpillFile() {
+        file.close();
+        std::error_code ignored;
+        std::filesystem::remove(path, ignored);
+    }
+
+    SpillFile(const SpillFile&) = delete;
+    SpillFile& operator=(const SpillFile&) = delete;
+
+    // Append `count` events to the end of the file; appends that follow each
+    // other extend the same run
+    void append(SpillRun& run, const MidiEvent* events, std::size_t count) {
+        if (run.count == 0) {
+            run.offset = size;
+        } else if (run.offset + run.count * sizeof(MidiEvent) != size) {
+            throw std::runtime_error("spill run is not at the end of " + path.string());
+        }
+        file.seekp(static_cast<std::streamoff>(size));
+        file.write(reinterpret_cast<const char*>(events), static_cast<std::streamsize>(count * sizeof(MidiEvent)));
+        if (!file) {
+            throw std::runtime_error("cannot write " + path.string());
+        }
+        size += count * sizeof(MidiEvent);
+        run.count += count;
+    }
+
+    // Read `count` events starting at event `first` of `run`
+    void read(const SpillRun& run, std::size_t first, MidiEvent* events, std::size_t count) {
+        file.seekg(static_cast<std::streamoff>(run.offset + first * sizeof(MidiEvent)));
+        file.read(reinterpret_cast<char*>(events), static_cast<std::streamsize>(count * sizeof(MidiEvent)));
+        if (!file) {
+            throw std::runtime_error("cannot read " + path.string());
+        }
+    }
+
+private:
+    std::filesystem::path path;
+    std::fstream file;
+    std::uint64_t size = 0;
+};
+
+// Reads spilled runs one after another through a fixed buffer, then
+// optionally the events that are still in memory
+class SpillReader {
+public:
+    SpillReader(SpillFile& file, std::vector<SpillRun> runs, std::size_t bufferEvents,
+                const std::vector<MidiEvent>* pending = nullptr)
+        : file(file), runs(std::move(runs)), pending(pending), buffer(bufferEvents) {}
+
+    bool next(MidiEvent& event) {
+        if (current == end && !refill()) {
+            return false;
+        }
+        event = *current++;
+        return true;
+    }
+
+private:
+    bool refill() {
+        if (runIndex < runs.size()) {
+            const SpillRun& run = runs[runIndex];
+            std::size_t count = std::min(buffer.size(), run.count - runPosition);
+            file.read(run, runPosition, buffer.data(), count);
+            runPosition += count;
+            if (runPosition == run.count) {
+                ++runIndex;
+                runPosition = 0;
             }
+            current = buffer.data();
+            end = current + count;
+            return true;
+        }
+        if (pending != nullptr && !pending->empty()) {
+            current = pending->data();
+            end = current + pending->size();
+            pending = nullptr;
+            return true;
+        }
+        return false;
+    }
 
-            // Write note event
-            if (event.isNoteOn) {
-                // Note on: 0x90 | channel, note, velocity
-                midiFile.put(0x90);
-                midiFile.put(static_cast<char>(event.noteNumber));
-                midiFile.put(0x64); // Velocity (100)
-            } else {
-                // Note off: 0x80 | channel, note, velocity
-                midiFile.put(0x80);
-                midiFile.put(static_cast<char>(event.noteNumber));
-                midiFile.put(0x00); // Velocity (0)
+    SpillFile& file;
+    std::vector<SpillRun> runs;
+    const std::vector<MidiEvent>* pending;
+    std::vector<MidiEvent> buffer;
+    std::size_t runIndex = 0;
+    std::size_t runPosition = 0;
+    const MidiEvent* current = nullptr;
+    const MidiEvent* end = nullptr;
+};
+
+// Merge sorted runs into one sequence in time order, passing each event to
+// `emit`. Events at the same time keep the order of their runs.
+template <typename Emit>
+void mergeSpillRuns(SpillFile& file, const std::vector<SpillRun>& runs, std::size_t bufferEvents,
+                    const Emit& emit) {
+    std::vector<SpillReader> readers;
+    readers.reserve(runs.size());
+    for (const SpillRun& run : runs) {
+        readers.emplace_back(file, std::vector<SpillRun>{run},
+                             std::max(bufferEvents / runs.size(), SpillBudget::MIN_SPILL_READ_EVENTS));
+    }
+
+    // Min-heap of the next event of every reader
+    struct Head {
+        MidiEvent event;
+        std::size_t reader;
+    };
+    auto after = [](const Head& a, const Head& b) {
+        MidiEventBefore before;
+        return before(b.event, a.event) || (!before(a.event, b.event) && a.reader > b.reader);
+    };
+    std::vector<Head> heap;
+    for (std::size_t r = 0; r < readers.size(); ++r) {
+        Head head{MidiEvent(), r};
+        if (readers[r].next(head.event)) {
+            heap.push_back(head);
+        }
+    }
+    std::make_heap(heap.begin(), heap.end(), after);
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), after);
+        Head& head = heap.back();
+        emit(head.event);
+        if (readers[head.reader].next(head.event)) {
+            std::push_heap(heap.begin(), heap.end(), after);
+        } else {
+            heap.pop_back();
+        }
+    }
+}
+
+// Note-ons of every track for convertToMidi under a memory budget. Tracks
+// keep their note-ons in memory until all of them together reach the
+// budget's share; then every track's note-ons are appended to the spill file
+// as one more run of that track.
+class SpillingMidiBuilder {
+public:
+    struct Track {
+        int number = 0;
+        std::size_t noteCount = 0;
+        std::int64_t endTick = 0;
+        bool sequential = true;   // As MidiTrack::sequential
+        std::vector<SpillRun> runs;
+        std::vector<MidiEvent> pending;
+    };
+
+    SpillingMidiBuilder(SpillFile& file, std::size_t pendingLimit) : file(file), pendingLimit(pendingLimit) {}
+
+    void addNote(const MidiNote& note) {
+        std::uint32_t index = remap.indexOf(note.track);
+        if (index == tracks.size()) {
+            tracks.emplace_back();
+            tracks.back().number = note.track;
+        }
+        Track& track = tracks[index];
+        track.pending.push_back(MidiEvent(track.endTick, note.noteNumber, true, NOTE_ON_VELOCITY));
+        ++track.noteCount;
+        track.sequential = track.sequential && note.duration > 0;
+        track.endTick += note.duration;
+        if (++pendingCount >= pendingLimit) {
+            spill();
+        }
+    }
+
+    // Tracks in track number order
+    std::vector<Track*> trackList() {
+        std::vector<Track*> list;
+        for (Track& track : tracks) {
+            list.push_back(&track);
+        }
+        std::sort(list.begin(), list.end(), [](const Track* a, const Track* b) { return a->number < b->number; });
+        return list;
+    }
+
+private:
+    void spill() {
+        for (Track& track : tracks) {
+            if (!track.pending.empty()) {
+                track.runs.emplace_back();
+                file.append(track.runs.back(), track.pending.data(), track.pending.size());
+                std::vector<MidiEvent>().swap(track.pending);
             }
         }
+        pendingCount = 0;
+    }
+
+    SpillFile& file;
+    std::size_t pendingLimit;
+    std::size_t pendingCount = 0;
+    TrackRemap remap;
+    std::deque<Track> tracks;
+};
+
+// Output for MidiTrackEncoder that writes through a fixed buffer to
+// consecutive offsets of a file
+class MidiFileStream {
+public:
+    MidiFileStream(PositionalFile& file, std::uint64_t offset, std::size_t bufferBytes)
+        : file(file), offset(offset), buffer(std::max(bufferBytes, MAX_VLQ_BYTES)) {}
+
+    void vlq(std::uint32_t value) {
+        if (used + MAX_VLQ_BYTES > buffer.size()) {
+            flush();
+        }
+        used += encodeVlq(value, buffer.data() + used);
+    }
+
+    void byte(unsigned char value) {
+        if (used == buffer.size()) {
+            flush();
+        }
+        buffer[used++] = value;
+    }
+
+    void flush() {
+        if (used > 0 && !file.writeAt(offset, buffer.data(), used)) {
+            failed = true;
+        }
+        offset += used;
+        used = 0;
+    }
+
+    // Offset of the next byte
+    std::uint64_t position() const {
+        return offset + used;
+    }
 
-        // Write end of track
-        midiFile.put(0x00); // Delta time
-        midiFile.put(0xFF); // Meta event
-        midiFile.put(0x2F); // End of track
-        midiFile.put(0x00); // Length
+    bool failed = false;
 
-        // Calculate and write track length
-        long trackEndPos = midiFile.tellp();
-        long trackLength = trackEndPos - trackStartPos;
+private:
+    PositionalFile& file;
+    std::uint64_t offset;
+    std::vector<unsigned char> buffer;
+    std::size_t used = 0;
+};
 
-        midiFile.seekp(trackLengthPos);
-        char trackLengthBytes[4] = {
-            static_cast<char>((trackLength >> 24) & 0xFF),
-            static_cast<char>((trackLength >> 16) & 0xFF),
-            static_cast<char>((trackLength >> 8) & 0xFF),
-            static_cast<char>(trackLength & 0xFF)
-        };
-        midiFile.write(trackLengthBytes, 4);
-        midiFile.seekp(trackEndPos);
+// Encode the events of one track of a SpillingMidiBuilder. Sequential tracks
+// are streamed straight from their note-ons. Overlapping tracks are sorted
+// externally: their events are sorted in runs that fit the budget, the runs
+// spilled and merged back while encoding, at most so many at a time that
+// each keeps a useful read buffer.
+void encodeSpilledTrack(MidiTrackEncoder<MidiFileStream>& encoder, SpillingMidiBuilder::Track& track,
+                        SpillFile& spill, const SpillBudget& budget) {
+    SpillReader noteOns(spill, track.runs, budget.readEvents, &track.pending);
+    // Each note-on with its note-off, which is at the next note's tick
+    auto forEachNote = [&](const auto& note) {
+        MidiEvent noteOn;
+        bool haveNote = noteOns.next(noteOn);
+        while (haveNote) {
+            MidiEvent nextNoteOn;
+            bool haveNext = noteOns.next(nextNoteOn);
+            note(noteOn, MidiEvent(haveNext ? nextNoteOn.tick() : track.endTick, noteOn.noteNumber(), false, 0));
+            noteOn = nextNoteOn;
+            haveNote = haveNext;
+        }
+    };
+
+    if (track.sequential) {
+        forEachNote([&](const MidiEvent& noteOn, const MidiEvent& noteOff) {
+            encoder.event(noteOn);
+            encoder.event(noteOff);
+        });
+        return;
+    }
+
+    std::vector<MidiEvent> sortBuffer;
+    sortBuffer.reserve(std::min(budget.sortEvents, 2 * track.noteCount));
+    std::vector<SpillRun> sortedRuns;
+    auto spillSorted = [&] {
+        std::sort(sortBuffer.begin(), sortBuffer.end(), MidiEventBefore());
+        sortedRuns.emplace_back();
+        spill.append(sortedRuns.back(), sortBuffer.data(), sortBuffer.size());
+        sortBuffer.clear();
+    };
+    forEachNote([&](const MidiEvent& noteOn, const MidiEvent& noteOff) {
+        if (sortBuffer.size() + 2 > budget.sortEvents) {
+            spillSorted();
+        }
+        sortBuffer.push_back(noteOn);
+        sortBuffer.push_back(noteOff);
+    });
+    if (sortedRuns.empty()) {
+        // The whole track fit in memory
+        std::sort(sortBuffer.begin(), sortBuffer.end(), MidiEventBefore());
+        for (const MidiEvent& event : sortBuffer) {
+            encoder.event(event);
+        }
+        return;
+    }
+    if (!sortBuffer.empty()) {
+        spillSorted();
+    }
+    std::vector<MidiEvent>().swap(sortBuffer);
+
+    // Merge passes until few enough runs are left for the final merge
+    const std::size_t fanIn = std::max<std::size_t>(budget.mergeEvents / SpillBudget::MIN_SPILL_READ_EVENTS, 2);
+    while (sortedRuns.size() > fanIn) {
+        std::vector<SpillRun> mergedRuns;
+        std::vector<MidiEvent> output;
+        output.reserve(budget.mergeEvents);
+        for (std::size_t first = 0; first < sortedRuns.size(); first += fanIn) {
+            std::vector<SpillRun> group(sortedRuns.begin() + first,
+                                        sortedRuns.begin() + std::min(first + fanIn, sortedRuns.size()));
+            mergedRuns.emplace_back();
+            mergeSpillRuns(spill, group, budget.mergeEvents, [&](const MidiEvent& event) {
+                output.push_back(event);
+                if (output.size() == budget.mergeEvents) {
+                    spill.append(mergedRuns.back(), output.data(), output.size());
+                    output.clear();
+                }
+            });
+            if (!output.empty()) {
+                spill.append(mergedRuns.back(), output.data(), output.size());
+                output.clear();
+            }
+        }
+        sortedRuns.swap(mergedRuns);
+    }
+    mergeSpillRuns(spill, sortedRuns, budget.mergeEvents, [&](const MidiEvent& event) { encoder.event(event); });
+}
+
+// Write the tracks of a SpillingMidiBuilder as a format 1 MIDI file, one
+// track after another in track number order. Chunk lengths are not known
+// in advance, so each track header is written once its chunk is complete.
+void writeSpilledMidiFile(const std::string& outputFile, SpillingMidiBuilder& midi, SpillFile& spill,
+                          const SpillBudget& budget, AppState& state) {
+    PositionalFile midiFile(outputFile);
+    if (!midiFile.isOpen()) {
+        state.statusMessage += "Error opening output MIDI file: " + outputFile + "\n";
+        return;
+    }
+
+    std::vector<SpillingMidiBuilder::Track*> tracks = midi.trackList();
+    bool writeFailed = !writeMidiHeader(midiFile, tracks.size());
+    MidiFileStream output(midiFile, MIDI_HEADER_BYTES, budget.outputBytes);
+    for (SpillingMidiBuilder::Track* track : tracks) {
+        // Reserve the track header, then stream the body after it
+        std::uint64_t chunkOffset = output.position();
+        for (int i = 0; i < 8; ++i) {
+            output.byte(0);
+        }
+        MidiTrackEncoder<MidiFileStream> encoder(output, state.compactMidi);
+        encodeSpilledTrack(encoder, *track, spill, budget);
+        encoder.finish();
+        output.flush();
+
+        unsigned char header[8] = {'M', 'T', 'r', 'k'};
+        storeBigEndian32(static_cast<std::uint32_t>(output.position() - chunkOffset - 8), header + 4);
+        if (!midiFile.writeAt(chunkOffset, header, sizeof(header))) {
+            writeFailed = true;
+        }
+
+        // The track's events are no longer needed
+        std::vector<MidiEvent>().swap(track->pending);
     }
 
-    midiFile.close();
+    if (writeFailed || output.failed) {
+        state.statusMessage += "Error writing MIDI file: " + outputFile + "\n";
+        return;
+    }
     state.statusMessage += "MIDI file created successfully: " + outputFile + "\n";
+}
+
+// Note files hold the notes of a run in binary, for archiving and rendering
+// MIDI again without the text output. All values are little-endian:
+//  - NoteFileHeader (40 bytes)
+//  - uint32 string offsets[labelCount + variantCount + 1] into the string data
+//  - the string data: labelCount labels, then variantCount variant names,
+//    padded with zeros to a multiple of 4 bytes
+//  - columns of noteCount values: int32 track, int32 duration, uint32 label
+//    id, uint8 pitch, uint8 variant id
+// The columns are aligned, so a mapped file is used in place.
+constexpr char NOTE_FILE_MAGIC[8] = {'T', 'U', 'R', 'N', 'N', 'O', 'T', 'E'};
+constexpr std::uint32_t NOTE_FILE_VERSION = 1;
+constexpr std::uint32_t NOTE_FILE_BYTE_ORDER = 0x01020304;
+
+struct NoteFileHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byteOrder;  // NOTE_FILE_BYTE_ORDER as written by the host
+    std::uint64_t noteCount;
+    std::uint32_t labelCount;
+    std::uint32_t variantCount;
+    std::uint32_t stringBytes;
+    std::uint32_t reserved;
+};
+static_assert(sizeof(NoteFileHeader) == 40, "note file header layout");
+
+// Bytes of the column data of `noteCount` notes
+constexpr std::uint64_t NOTE_FILE_BYTES_PER_NOTE = 4 + 4 + 4 + 1 + 1;
+
+// Offset of the columns, after the header, string offsets and padded strings
+std::uint64_t noteFileColumnsOffset(std::uint64_t stringCount, std::uint64_t stringBytes) {
+    std::uint64_t end = sizeof(NoteFileHeader) + 4 * (stringCount + 1) + stringBytes;
+    return (end + 3) & ~std::uint64_t(3);
+}
+
+// Write `notes` as a note file. Labels are numbered in order of first use;
+// variant ids are VariantId values, then ORIGINAL and the empty variant.
+bool writeNoteFile(const std::string& path, const std::vector<MidiNote>& notes) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    std::vector<std::string_view> strings;
+    std::unordered_map<std::string_view, std::uint32_t> labelIds;
+    std::vector<std::uint32_t> labelColumn(notes.size());
+    for (std::size_t i = 0; i < notes.size(); ++i) {
+        auto inserted = labelIds.emplace(notes[i].label, static_cast<std::uint32_t>(strings.size()));
+        if (inserted.second) {
+            strings.push_back(notes[i].label);
+        }
+        labelColumn[i] = inserted.first->second;
+    }
+    std::uint32_t labelCount = static_cast<std::uint32_t>(strings.size());
+    for (const VariantSpec& variant : TURN_VARIANT_TABLE) {
+        strings.push_back(variant.name);
+    }
+    strings.push_back("ORIGINAL");
+    strings.push_back("");
+
+    NoteFileHeader header{};
+    std::memcpy(header.magic, NOTE_FILE_MAGIC, sizeof(header.magic));
+    header.version = NOTE_FILE_VERSION;
+    header.byteOrder = NOTE_FILE_BYTE_ORDER;
+    header.noteCount = notes.size();
+    header.labelCount = labelCount;
+    header.variantCount = VARIANT_COUNT + 2;
+
+    std::vector<std::uint32_t> offsets;
+    std::string stringData;
+    for (std::string_view text : strings) {
+        offsets.push_back(static_cast<std::uint32_t>(stringData.size()));
+        stringData.append(text);
+    }
+    offsets.push_back(static_cast<std::uint32_t>(stringData.size()));
+    header.stringBytes = static_cast<std::uint32_t>(stringData.size());
+    stringData.resize(noteFileColumnsOffset(strings.size(), stringData.size()) -
+                      sizeof(NoteFileHeader) - 4 * offsets.size(), '\0');
+
+    std::vector<std::int32_t> trackColumn(notes.size());
+    std::vector<std::int32_t> durationColumn(notes.size());
+    std::vector<std::uint8_t> pitchColumn(notes.size());
+    std::vector<std::uint8_t> variantColumn(notes.size());
+    for (std::size_t i = 0; i < notes.size(); ++i) {
+        trackColumn[i] = notes[i].track;
+        durationColumn[i] = notes[i].duration;
+        pitchColumn[i] = static_cast<std::uint8_t>(notes[i].noteNumber);
+        variantColumn[i] = notes[i].variant;
+    }
+
+    auto writeBytes = [&file](const void* data, std::size_t bytes) {
+        file.write(static_cast<const char*>(data), static_cast<std::streamsize>(bytes));
+    };
+    writeBytes(&header, sizeof(header));
+    writeBytes(offsets.data(), offsets.size() * sizeof(std::uint32_t));
+    writeBytes(stringData.data(), stringData.size());
+    writeBytes(trackColumn.data(), notes.size() * sizeof(std::int32_t));
+    writeBytes(durationColumn.data(), notes.size() * sizeof(std::int32_t));
+    writeBytes(labelColumn.data(), notes.size() * sizeof(std::uint32_t));
+    writeBytes(pitchColumn.data(), notes.size());
+    writeBytes(variantColumn.data(), notes.size());
+    return static_cast<bool>(file);
+}
+
+// The columns and string tables of a note file, pointing into its contents
+struct NoteFileView {
+    std::size_t noteCount = 0;
+    const std::int32_t* tracks = nullptr;
+    const std::int32_t* durations = nullptr;
+    const std::uint32_t* labelIds = nullptr;
+    const std::uint8_t* pitches = nullptr;
+    const std::uint8_t* variantIds = nullptr;
+    std::vector<std::string_view> labels;
+    std::vector<std::string_view> variants;
+};
+
+// The notes of a NoteFileView as MidiEventBuilder::addNotes reads them
+struct NoteFileNotes {
+    const NoteFileView& view;
+
+    std::size_t size() const {
+        return view.noteCount;
+    }
+
+    MidiNote operator[](std::size_t i) const {
+        return MidiNote{view.tracks[i], view.pitches[i], view.durations[i],
+                        view.labels[view.labelIds[i]], view.variantIds[i]};
+    }
+};
+
+bool isNoteFile(std::string_view contents) {
+    return contents.size() >= sizeof(NOTE_FILE_MAGIC) &&
+           std::memcmp(contents.data(), NOTE_FILE_MAGIC, sizeof(NOTE_FILE_MAGIC)) == 0;
+}
+
+// Check the layout of a note file and point a view at its columns. `contents`
+// must be 4-byte aligned, as mapped files are. Throws std::runtime_error for
+// files that are damaged or from an unsupported version.
+NoteFileView readNoteFile(std::string_view contents) {
+    if (!isNoteFile(contents)) {
+        throw std::runtime_error("not a note file");
+    }
+    if (contents.size() < sizeof(NoteFileHeader)) {
+        throw std::runtime_error("file is truncated");
+    }
+    NoteFileHeader header;
+    std::memcpy(&header, contents.data(), sizeof(header));
+    if (header.byteOrder != NOTE_FILE_BYTE_ORDER) {
+        throw std::runtime_error("written with a different byte order");
+    }
+    if (header.version != NOTE_FILE_VERSION) {
+        throw std::runtime_error("unsupported version " + std::to_string(header.version));
+    }
+
+    std::uint64_t stringCount = std::uint64_t(header.labelCount) + header.variantCount;
+    if (stringCount >= contents.size() || header.stringBytes >= contents.size() ||
+        header.noteCount > contents.size() / NOTE_FILE_BYTES_PER_NOTE) {
+        throw std::runtime_error("file is truncated");
+    }
+    std::uint64_t columnsOffset = noteFileColumnsOffset(stringCount, header.stringBytes);
+    if (columnsOffset + header.noteCount * NOTE_FILE_BYTES_PER_NOTE != contents.size()) {
+        throw std::runtime_error("file size does not match its header");
+    }
+
+    // String tables
+    const char* base = contents.data();
+    const char* stringData = base + sizeof(NoteFileHeader) + 4 * (stringCount + 1);
+    std::vector<std::string_view> strings;
+    std::uint32_t start = 0;
+    std::memcpy(&start, base + sizeof(NoteFileHeader), 4);
+    for (std::uint64_t i = 0; i < stringCount; ++i) {
+        std::uint32_t end = 0;
+        std::memcpy(&end, base + sizeof(NoteFileHeader) + 4 * (i + 1), 4);
+        if (start > end || end > header.stringBytes) {
+            throw std::runtime_error("damaged string table");
+        }
+        strings.emplace_back(stringData + start, end - start);
+        start = end;
+    }
+
+    NoteFileView view;
+    view.labels.assign(strings.begin(), strings.begin() + header.labelCount);
+    view.variants.assign(strings.begin() + header.labelCount, strings.end());
+    view.noteCount = static_cast<std::size_t>(header.noteCount);
+    const char* columns = base + columnsOffset;
+    view.tracks = reinterpret_cast<const std::int32_t*>(columns);
+    view.durations = reinterpret_cast<const std::int32_t*>(columns + 4 * view.noteCount);
+    view.labelIds = reinterpret_cast<const std::uint32_t*>(columns + 8 * view.noteCount);
+    view.pitches = reinterpret_cast<const std::uint8_t*>(columns + 12 * view.noteCount);
+    view.variantIds = view.pitches + view.noteCount;
+    return view;
+}
+
+// Transform the input and write the text rows to `outputFile` and the notes
+// straight to the MIDI file `midiOutputFile`, without reading the text back.
+// Either output name may be empty to skip that output. The MIDI file and the
+// status message match running processFile and then convertToMidi. With
+// AppState::noteFile set, the notes are also saved as a note file. With
+// AppState::memoryBudget set, the notes of each chunk go straight into a
+// SpillingMidiBuilder, so the MIDI events stay within the budget as in
+// convertToMidi; a note file still needs all notes in memory.
+void processFileToMidi(const std::string& inputFile, const std::string& outputFile,
+                       const std::string& midiOutputFile, AppState& state) {
+    const bool writeText = !outputFile.empty();
+    const bool buildMidi = !midiOutputFile.empty();
+    const bool collectNotes = buildMidi || !state.noteFile.empty();
+    const bool spillMidi = buildMidi && state.memoryBudget > 0;
+    MappedFile input(inputFile);
+    std::ofstream output;
+    if (writeText) {
+        output.open(outputFile);
+    }
+
+    if (!input.isOpen() || (writeText && !output.is_open())) {
+        state.statusMessage = "Error opening files.";
+        return;
+    }
+
+    // Intern the labels and mark the eligible ones
+    std::vector<std::string> eligibleLabels;
+    if (!state.labelFile.empty() && !loadLabelFile(state.labelFile, eligibleLabels)) {
+        state.statusMessage = "Error opening label file.";
+        return;
+    }
+    LabelDictionary labels;
+    try {
+        labels = buildLabelDictionary(state.labelFile.empty() ? nullptr : &eligibleLabels);
+    } catch (const std::exception& e) {
+        state.statusMessage = std::string("Error in label file: ") + e.what();
+        return;
+    }
+
+    // Write header to the output file
+    RowFormatter formatter(output);
+    if (writeText) {
+        formatter.column("Track", TRACK_COLUMN_WIDTH);
+        formatter.column("Note", NOTE_COLUMN_WIDTH);
+        formatter.column("Duration", DURATION_COLUMN_WIDTH);
+        formatter.column("Label", LABEL_COLUMN_WIDTH);
+        formatter.column("Turn_Variant", VARIANT_COLUMN_WIDTH);
+        formatter.endRow();
+        formatter.text("---------------------------------------------------------------------------------");
+        formatter.endRow();
+    }
+
+    // Reset statistics
+    state.totalEligibleNotes = 0;
+    state.transformedNotes = 0;
+    state.variantUsageCount.clear();
+
+    // Resolve the selected variant names to ids once, instead of comparing strings per note
+    ProcessSettings settings;
+    settings.labels = &labels;
+    settings.selectedVariants = &state.selectedVariants;
+    settings.useRandomVariant = state.selectedVariants.empty() ||
+        (state.selectedVariants.size() == 1 && state.selectedVariants[0] == "RANDOM");
+    for (const auto& name : state.selectedVariants) {
+        settings.selectedVariantIds.push_back(findVariantId(name));
+    }
+    settings.variantChoices = settings.useRandomVariant ? VARIANT_COUNT :
+        static_cast<std::uint32_t>(settings.selectedVariantIds.size());
+
+    // Per-line randomness is keyed by the seed, so reruns reproduce exactly
+    settings.transformChance = makeTransformChance(state.transformationPercentage);
+    settings.randomSeed = state.randomSeed;
+
+    // Within a memory budget the MIDI events are spilled as the chunks arrive
+    SpillBudget budget(state.memoryBudget);
+    std::unique_ptr<SpillFile> spill;
+    std::unique_ptr<SpillingMidiBuilder> spilledMidi;
+    std::string spillError;
+    if (spillMidi) {
+        try {
+            spill = std::make_unique<SpillFile>();
+            spilledMidi = std::make_unique<SpillingMidiBuilder>(*spill, budget.pendingEvents);
+        } catch (const std::exception& e) {
+            state.statusMessage = std::string("Error in temporary MIDI data: ") + e.what();
+            return;
+        }
+    }
+
+    unsigned int threadCount = resolveThreadCount(state.threadCount);
+    ChunkStatistics statistics;
+    std::vector<MidiNote> midiNotes;
+    MidiNoteSink noteSink = [&](const std::vector<MidiNote>& chunkNotes) {
+        if (spilledMidi && spillError.empty()) {
+            try {
+                for (const MidiNote& note : chunkNotes) {
+                    spilledMidi->addNote(note);
+                }
+            } catch (const std::exception& e) {
+                spillError = e.what();
+            }
+        }
+        if (!spilledMidi || !state.noteFile.empty()) {
+            midiNotes.insert(midiNotes.end(), chunkNotes.begin(), chunkNotes.end());
+        }
+    };
+    state.pipelineReport.clear();
+    if (threadCount > 1 || spillMidi) {
+        // The pipeline hands over the notes chunk by chunk, which a budget needs even on one thread
+        formatter.flush();
+        PipelineStatistics pipeline;
+        runProcessPipeline(input.contents(), settings, threadCount, writeText ? &output : nullptr,
+                           collectNotes ? &noteSink : nullptr, statistics, pipeline);
+        if (threadCount > 1) {
+            state.pipelineReport = describePipeline(pipeline, threadCount);
+        }
+    } else {
+        processChunk(input.contents(), 0, settings, writeText ? &formatter : nullptr, statistics,
+                     collectNotes ? &midiNotes : nullptr);
+    }
+
+    if (writeText) {
+        formatter.flush();
+        output.close();
+    }
+
+    state.totalEligibleNotes = statistics.totalEligibleNotes;
+    state.transformedNotes = statistics.transformedNotes;
+    for (int i = 0; i < VARIANT_COUNT; ++i) {
+        if (statistics.variantUsage[i] > 0) {
+            state.variantUsageCount[std::string(TURN_VARIANT_TABLE[i].name)] = statistics.variantUsage[i];
+        }
+    }
+
+    // Calculate actual percentage
+    double actualPercentage = state.totalEligibleNotes > 0 ?
+        (static_cast<double>(state.transformedNotes) / state.totalEligibleNotes) * 100.0 : 0.0;
+
+    // Update result summary
+    std::stringstream summary;
+    summary << "Transformation Statistics:\n"
+            << "Total eligible notes found: " << state.totalEligibleNotes << "\n"
+            << "Notes transformed: " << state.transformedNotes << "\n"
+            << "Actual transformation percentage: " << std::fixed << std::setprecision(1)
+            << actualPercentage << "%\n"
+            << "Random seed: " << state.randomSeed << "\n\n";
+
+    if (state.selectedVariants.size() == 1 && state.selectedVariants[0] != "RANDOM") {
+        summary << "Variant used: " << state.selectedVariants[0] << "\n";
+    } else if (state.selectedVariants.size() > 1) {
+        summary << "Variants used (" << state.selectedVariants.size() << " total):\n";
+        for (const auto& [variant, count] : state.variantUsageCount) {
+            summary << "  " << variant << ": " << count << " times\n";
+        }
+    } else {
+        summary << "Variant selection: Random\n";
+    }
+
+    if (writeText) {
+        summary << "Processing complete. Transformed results written to " << outputFile << "\n";
+    }
+    if (buildMidi) {
+        summary << "Processing complete. MIDI notes written to " << midiOutputFile << "\n";
+    }
+    if (!state.noteFile.empty()) {
+        summary << "Processing complete. Notes saved to " << state.noteFile << "\n";
+    }
+    state.resultSummary = summary.str();
+    state.statusMessage = "Processing complete!";
+    state.processingComplete = true;
+
+    // Notes that could not be transformed are reported after the completion message
+    if (!statistics.errors.empty()) {
+        state.statusMessage += "\n" + statistics.errors;
+    }
+    if (collectNotes) {
+        state.statusMessage += statistics.midiErrors;
+    }
+    if (!state.noteFile.empty() && !writeNoteFile(state.noteFile, midiNotes)) {
+        state.statusMessage += "Error writing note file: " + state.noteFile + "\n";
+    }
+    if (spillMidi) {
+        try {
+            if (!spillError.empty()) {
+                throw std::runtime_error(spillError);
+            }
+            writeSpilledMidiFile(midiOutputFile, *spilledMidi, *spill, budget, state);
+        } catch (const std::exception& e) {
+            state.statusMessage += std::string("Error in temporary MIDI data: ") + e.what() + "\n";
+        }
+    } else if (buildMidi) {
+        MidiEventBuilder midi;
+        midi.addNotes(midiNotes);
+        writeMidiFile(midiOutputFile, midi, state);
+    }
+}
+
+// Function to process file with GUI integration
+void processFile(const std::string& inputFile, const std::string& outputFile, AppState& state) {
+    processFileToMidi(inputFile, outputFile, "", state);
+}
+
+// Pass the notes of a text output of processFile to `emit` in input order;
+// notes that cannot be read are reported in the status message
+template <typename Emit>
+void parseTextNotes(std::string_view contents, AppState& state, const Emit& emit) {
+    // Skip header lines
+    StructuralLineReader reader(contents);
+    IndexedLine line;
+    reader.next(line); // Skip column headers
+    reader.next(line); // Skip separator line
+
+    NoteFields fields;
+    while (reader.next(line)) {
+        // Skip lines that don't contain note data
+        if (line.text.empty() || line.text[0] == '-' ||
+            line.text.find("MIDI File Analyzed") != std::string_view::npos) {
+            continue;
+        }
+
+        // Parse the line
+        if (!parseIndexedNoteFields(line, fields)) {
+            continue; // Skip malformed lines
+        }
+        int track = fields.track;
+        std::string_view noteName = fields.noteName;
+        int duration = fields.duration;
+
+        // Skip header or non-note lines
+        if (noteName == "Note" || noteName == "Track") {
+            continue;
+        }
+
+        int noteNumber = 0;
+        NoteParseError noteError = parseNoteName(noteName, noteNumber);
+        if (noteError != NoteParseError::None) {
+            state.statusMessage += "Error processing note '" + std::string(noteName) + "': " +
+                                   noteParseErrorMessage(noteError, noteName) + "\n";
+            continue;
+        }
+
+        emit(MidiNote{track, noteNumber, duration, fields.label});
+    }
+}
+
+// Render the notes that `feed` passes on within AppState::memoryBudget,
+// spilling events to a temporary file as needed
+template <typename Feed>
+void convertWithMemoryBudget(const std::string& outputFile, const Feed& feed, AppState& state) {
+    try {
+        SpillBudget budget(state.memoryBudget);
+        SpillFile spill;
+        SpillingMidiBuilder midi(spill, budget.pendingEvents);
+        feed([&midi](const MidiNote& note) { midi.addNote(note); });
+        writeSpilledMidiFile(outputFile, midi, spill, budget, state);
+    } catch (const std::exception& e) {
+        state.statusMessage += std::string("Error in temporary MIDI data: ") + e.what() + "\n";
+    }
+}
+
+// Function to convert processed data to MIDI file with MIDI sync fix. The
+// input is either the text output of processFile or a note file. With
+// AppState::memoryBudget set, memory use stays within the budget however
+// large the input is.
+void convertToMidi(const std::string& inputFile, const std::string& outputFile, AppState& state) {
+    MappedFile input(inputFile);
+    if (!input.isOpen()) {
+        state.statusMessage += "Error opening input file: " + inputFile + "\n";
+        return;
+    }
+
+    if (isNoteFile(input.contents())) {
+        NoteFileView notes;
+        try {
+            notes = readNoteFile(input.contents());
+        } catch (const std::exception& e) {
+            state.statusMessage += "Error reading note file " + inputFile + ": " + e.what() + "\n";
+            return;
+        }
+        for (std::size_t i = 0; i < notes.noteCount; ++i) {
+            if (notes.pitches[i] >= MIDI_PITCH_COUNT || notes.labelIds[i] >= notes.labels.size() ||
+                notes.variantIds[i] >= notes.variants.size()) {
+                state.statusMessage += "Error reading note file " + inputFile + ": damaged note " +
+                                       std::to_string(i) + "\n";
+                return;
+            }
+        }
+        NoteFileNotes noteList{notes};
+        if (state.memoryBudget > 0) {
+            convertWithMemoryBudget(outputFile, [&noteList](const auto& emit) {
+                for (std::size_t i = 0; i < noteList.size(); ++i) {
+                    emit(noteList[i]);
+                }
+            }, state);
+            return;
+        }
+        MidiEventBuilder midi;
+        midi.addNotes(noteList);
+        writeMidiFile(outputFile, midi, state);
+        return;
+    }
+
+    auto parse = [&](const auto& emit) { parseTextNotes(input.contents(), state, emit); };
+    if (state.memoryBudget > 0) {
+        convertWithMemoryBudget(outputFile, parse, state);
+        return;
+    }
+
+    // Parse the file and collect the notes
+    std::vector<MidiNote> midiNotes;
+    parse([&midiNotes](const MidiNote& note) { midiNotes.push_back(note); });
+
+    MidiEventBuilder midi;
+    midi.addNotes(midiNotes);
+    writeMidiFile(outputFile, midi, state);
 }
\ No newline at end of file
@@ -0,0 +1,87 @@
+// Turns Transformation Tool - Shared Declarations
+// The application state and the engine functions that the entry points in
+// main.cpp and the benchmark call. All of them include this header, so they
+// always agree on the layout of AppState and the turn expansion types.
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Application state
+struct AppState {
+    std::string inputFile;
+    std::string outputFile;
+    std::string midiOutputFile;
+    double transformationPercentage = 50.0;
+    std::vector<std::string> selectedVariants;
+    bool processingComplete = false;
+    std::string statusMessage;
+    std::string resultSummary;
+    int totalEligibleNotes = 0;
+    int transformedNotes = 0;
+    std::map<std::string, int> variantUsageCount;
+    std::uint64_t randomSeed = 0;  // Same seed, input and settings give the same output
+    std::string labelFile;  // Optional list of eligible labels, replaces the defaults
+    int threadCount = 1;    // Worker threads for processFile, 0 = one per core
+    std::string pipelineReport;  // Queue depths and stalls of the last multithreaded run
+    bool writeTextOutput = true;  // Command line --no-text: processFileToMidi writes only the MIDI file
+    std::string noteFile;  // Optional binary note file written by processFile, see writeNoteFile
+    bool convertOnly = false;  // Command line --convert: render a text output or note file to MIDI
+    bool compactMidi = false;  // Running status and note-on velocity 0 for note-offs in MIDI files
+    std::size_t memoryBudget = 0;  // Bytes of MIDI events convertToMidi keeps in memory, 0 = no limit
+};
+
+// Transform `inputFile` into the text output `outputFile`
+void processFile(const std::string& inputFile, const std::string& outputFile, AppState& state);
+
+// Render a text output of processFile, or a note file, to a MIDI file
+void convertToMidi(const std::string& inputFile, const std::string& outputFile, AppState& state);
+
+// processFile that also writes the MIDI file in the same pass; either output name may be empty
+void processFileToMidi(const std::string& inputFile, const std::string& outputFile,
+                       const std::string& midiOutputFile, AppState& state);
+
+// Enum for TimeMeter
+enum TimeMeter {
+    DUPLE,
+    TRIPLE
+};
+
+// Identifiers for every turn variant, defined with TURN_VARIANT_TABLE
+enum class VariantId : std::uint8_t;
+
+// One expanded note of a turn: MIDI pitch and duration
+struct Segment {
+    int pitch;
+    int duration;
+};
+
+// Output of expandTurnsBatch. The segments of all notes are stored back to back;
+// note i owns segments[offsets[i]] up to (not including) segments[offsets[i + 1]].
+struct TurnBatch {
+    std::vector<Segment> segments;
+    std::vector<std::uint32_t> offsets;
+    std::vector<std::uint32_t> grouped;  // Scratch: note indices grouped by segment layout
+};
+
+// Implementations of expandTurnsBatch
+enum class BatchKernel {
+    Auto,    // Fastest kernel the CPU supports
+    Scalar,  // Portable, one note at a time
+    Avx2     // Notes grouped by segment layout, eight notes per instruction
+};
+
+// Look up a variant by name, returns VariantId::Count if the name is unknown
+VariantId findVariantId(std::string_view name);
+
+// Whether `kernel` can run on this CPU; Auto and Scalar always can
+bool batchKernelAvailable(BatchKernel kernel);
+
+// Expand a whole buffer of notes given as parallel arrays in one pass
+void expandTurnsBatch(const int* pitches, const int* durations, const VariantId* variants,
+                      const TimeMeter* meters, std::size_t count, TurnBatch& out,
+                      BatchKernel kernel = BatchKernel::Auto);
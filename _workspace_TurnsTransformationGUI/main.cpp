@@ -7,6 +7,7 @@
 #include <vector>
 #include <memory>
 #include <map>
+#include <cstdint>
 
 // Platform detection
 #if defined(_WIN32) || defined(_WIN64)
@@ -27,24 +28,36 @@
     #error "Unsupported platform"
 #endif
 
-// Forward declarations of functions from TurnsTransformation.cpp
-struct AppState {
-    std::string inputFile;
-    std::string outputFile;
-    std::string midiOutputFile;
-    double transformationPercentage = 50.0;
-    std::vector<std::string> selectedVariants;
-    bool processingComplete = false;
-    std::string statusMessage;
-    std::string resultSummary;
-    int totalEligibleNotes = 0;
-    int transformedNotes = 0;
-    std::map<std::string, int> variantUsageCount;
-};
-
-// Forward declarations of functions from TurnsTransformation.cpp
-void processFile(const std::string& inputFile, const std::string& outputFile, AppState& state);
-void convertToMidi(const std::string& inputFile, const std::string& outputFile, AppState& state);
+#include "TurnsTransformation.h"
+
+// Apply "--option value" arguments to the state and return the remaining
+// positional arguments (argv[0] excluded)
+std::vector<std::string> parseCommandLine(int argc, char* argv[], AppState& state) {
+    std::vector<std::string> positional;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--seed" && i + 1 < argc) {
+            state.randomSeed = std::stoull(argv[++i]);
+        } else if (arg == "--labels" && i + 1 < argc) {
+            state.labelFile = argv[++i];
+        } else if (arg == "--threads" && i + 1 < argc) {
+            state.threadCount = std::stoi(argv[++i]);
+        } else if (arg == "--no-text") {
+            state.writeTextOutput = false;
+        } else if (arg == "--notes" && i + 1 < argc) {
+            state.noteFile = argv[++i];
+        } else if (arg == "--convert") {
+            state.convertOnly = true;
+        } else if (arg == "--compact-midi") {
+            state.compactMidi = true;
+        } else if (arg == "--memory-budget" && i + 1 < argc) {
+            state.memoryBudget = static_cast<std::size_t>(std::stoull(argv[++i])) << 20;  // Given in MiB
+        } else {
+            positional.push_back(arg);
+        }
+    }
+    return positional;
+}
 
 // Constants
 const int WINDOW_WIDTH = 800;
@@ -85,6 +98,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
 
     // Create application state
     AppState* state = new AppState();
+    parseCommandLine(__argc, __argv, *state);
 
     // Create window
     HWND hwnd = CreateWindowEx(
@@ -445,36 +459,46 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 // Linux GUI implementation using X11
 
 int main(int argc, char* argv[]) {
+    // Create application state
+    AppState state;
+    std::vector<std::string> args = parseCommandLine(argc, argv, state);
+
+    // Render an earlier text output or note file to MIDI
+    if (state.convertOnly && args.size() >= 2) {
+        convertToMidi(args[0], args[1], state);
+        std::cout << state.statusMessage << std::endl;
+        return 0;
+    }
+
     // Check if we're running in command-line mode
-    if (argc >= 3) {
+    if (args.size() >= 2) {
         // Command-line mode
-        AppState state;
-        state.inputFile = argv[1];
-        state.outputFile = argv[2];
+        state.inputFile = args[0];
+        state.outputFile = args[1];
         
-        if (argc > 3) {
-            state.midiOutputFile = argv[3];
+        if (args.size() > 2) {
+            state.midiOutputFile = args[2];
         }
         
-        if (argc > 4) {
-            state.transformationPercentage = std::stod(argv[4]);
+        if (args.size() > 3) {
+            state.transformationPercentage = std::stod(args[3]);
         }
         
-        if (argc > 5) {
-            state.selectedVariants.push_back(argv[5]);
+        if (args.size() > 4) {
+            state.selectedVariants.push_back(args[4]);
         } else {
             state.selectedVariants.push_back("RANDOM");
         }
         
-        // Process the file
-        processFile(state.inputFile, state.outputFile, state);
-        std::cout << state.statusMessage << std::endl;
-        
-        // Generate MIDI if output file is specified
+        // Process the file, generating MIDI in the same pass if an output file is specified
         if (!state.midiOutputFile.empty()) {
-            convertToMidi(state.outputFile, state.midiOutputFile, state);
-            std::cout << state.statusMessage << std::endl;
+            processFileToMidi(state.inputFile, state.writeTextOutput ? state.outputFile : "",
+                              state.midiOutputFile, state);
+        } else {
+            processFile(state.inputFile, state.outputFile, state);
         }
+        std::cout << state.statusMessage << std::endl;
+        std::cout << state.pipelineReport;
         
         return 0;
     }
@@ -513,9 +537,6 @@ int main(int argc, char* argv[]) {
     // Map window to display
     XMapWindow(display, window);
     
-    // Create application state
-    AppState state;
-    
     // Event loop
     XEvent event;
     bool running = true;
@@ -543,7 +564,9 @@ int main(int argc, char* argv[]) {
                 XAllocColor(display, colormap, &light_purple);
                 
                 // Save original foreground color
-                unsigned long original_fg = XGetForeground(display, gc);
+                XGCValues original_values;
+                XGetGCValues(display, gc, GCForeground, &original_values);
+                unsigned long original_fg = original_values.foreground;
                 
                 // Set light purple color for button backgrounds
                 XSetForeground(display, gc, light_purple.pixel);
@@ -705,39 +728,48 @@ int main(int argc, char* argv[]) {
 // Standard entry point for command-line usage
 #if !defined(PLATFORM_WINDOWS) && !defined(PLATFORM_LINUX)
 int main(int argc, char* argv[]) {
-    if (argc < 3) {
-        std::cout << "Usage: " << argv[0] << " <input_file> <output_file> [midi_output_file] [transformation_percentage] [variant]" << std::endl;
-        std::cout << "Example: " << argv[0] << " input.txt output.txt output.mid 50 RANDOM" << std::endl;
+    AppState state;
+    std::vector<std::string> args = parseCommandLine(argc, argv, state);
+
+    if (args.size() < 2) {
+        std::cout << "Usage: " << argv[0] << " [--seed N] [--labels FILE] [--threads N] [--no-text] [--notes FILE] [--compact-midi] [--memory-budget MB] <input_file> <output_file> [midi_output_file] [transformation_percentage] [variant]" << std::endl;
+        std::cout << "       " << argv[0] << " [--compact-midi] [--memory-budget MB] --convert <output_file_or_note_file> <midi_output_file>" << std::endl;
+        std::cout << "Example: " << argv[0] << " --seed 42 input.txt output.txt output.mid 50 RANDOM" << std::endl;
         return 1;
     }
 
-    AppState state;
-    state.inputFile = argv[1];
-    state.outputFile = argv[2];
+    if (state.convertOnly) {
+        convertToMidi(args[0], args[1], state);
+        std::cout << state.statusMessage << std::endl;
+        return 0;
+    }
+
+    state.inputFile = args[0];
+    state.outputFile = args[1];
     
-    if (argc > 3) {
-        state.midiOutputFile = argv[3];
+    if (args.size() > 2) {
+        state.midiOutputFile = args[2];
     }
     
-    if (argc > 4) {
-        state.transformationPercentage = std::stod(argv[4]);
+    if (args.size() > 3) {
+        state.transformationPercentage = std::stod(args[3]);
     }
     
-    if (argc > 5) {
-        state.selectedVariants.push_back(argv[5]);
+    if (args.size() > 4) {
+        state.selectedVariants.push_back(args[4]);
     } else {
         state.selectedVariants.push_back("RANDOM");
     }
     
-    // Process the file
-    processFile(state.inputFile, state.outputFile, state);
-    std::cout << state.statusMessage << std::endl;
-    
-    // Generate MIDI if output file is specified
+    // Process the file, generating MIDI in the same pass if an output file is specified
     if (!state.midiOutputFile.empty()) {
-        convertToMidi(state.outputFile, state.midiOutputFile, state);
-        std::cout << state.statusMessage << std::endl;
+        processFileToMidi(state.inputFile, state.writeTextOutput ? state.outputFile : "",
+                          state.midiOutputFile, state);
+    } else {
+        processFile(state.inputFile, state.outputFile, state);
     }
+    std::cout << state.statusMessage << std::endl;
+    std::cout << state.pipelineReport;
     
     return 0;
 }
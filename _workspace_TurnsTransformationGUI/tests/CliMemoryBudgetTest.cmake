@@ -0,0 +1,68 @@
+# Turns Transformation Tool - Command Line Memory Budget Test
+# Runs the real command line with --memory-budget 1 on an input large enough
+# to spill note events into several sorted runs, and checks that:
+#  - the MIDI file is identical to the one written without a budget,
+#  - --convert with a budget renders the text output to the same file,
+#  - --no-text still skips the text output,
+#  - the budget really takes the spill path: with no usable temp directory
+#    the run reports the temporary file error.
+#
+# Usage: cmake -DTOOL=<TurnsTransformation> -DWORK_DIR=<dir> -P CliMemoryBudgetTest.cmake
+
+file(REMOVE_RECURSE "${WORK_DIR}")
+file(MAKE_DIRECTORY "${WORK_DIR}")
+
+# 131072 lines. Track 3 has chords of zero and negative durations, so its
+# 131072 events are sorted into four runs of a 1 MiB budget, with many events
+# at the same tick split between runs.
+set(block "1 C4 480 I8\n3 F4 0 Q\n3 A4 0 Q\n2 D4 240 Q\n3 C5 -10 Q\n1 E4 120 SPD\n3 E5 5 Q\n2 G4 60 Q\n")
+foreach(doubling RANGE 1 14)
+    string(CONCAT block "${block}" "${block}")
+endforeach()
+file(WRITE "${WORK_DIR}/input.txt" "${block}")
+
+function(run_tool)
+    cmake_parse_arguments(RUN "" "OUTPUT" "ARGS;ENV" ${ARGN})
+    execute_process(COMMAND ${CMAKE_COMMAND} -E env ${RUN_ENV} "${TOOL}" ${RUN_ARGS}
+                    WORKING_DIRECTORY "${WORK_DIR}" OUTPUT_VARIABLE output ERROR_VARIABLE output
+                    RESULT_VARIABLE result)
+    if(NOT result EQUAL 0)
+        message(FATAL_ERROR "${TOOL} ${RUN_ARGS} failed (${result}):\n${output}")
+    endif()
+    set(${RUN_OUTPUT} "${output}" PARENT_SCOPE)
+endfunction()
+
+function(expect_same_file first second)
+    execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files "${WORK_DIR}/${first}" "${WORK_DIR}/${second}"
+                    RESULT_VARIABLE different)
+    if(different)
+        message(FATAL_ERROR "${first} and ${second} differ")
+    endif()
+endfunction()
+
+run_tool(OUTPUT reference ARGS --seed 5 input.txt reference.txt reference.mid 50)
+
+foreach(threads 1 4)
+    run_tool(OUTPUT budget ARGS --seed 5 --threads ${threads} --memory-budget 1 --no-text
+             input.txt budget${threads}.txt budget${threads}.mid 50)
+    if(NOT budget MATCHES "MIDI file created successfully")
+        message(FATAL_ERROR "No MIDI file with --memory-budget 1 --threads ${threads}:\n${budget}")
+    endif()
+    if(EXISTS "${WORK_DIR}/budget${threads}.txt")
+        message(FATAL_ERROR "--no-text wrote a text output with --memory-budget 1")
+    endif()
+    expect_same_file(reference.mid budget${threads}.mid)
+endforeach()
+
+run_tool(OUTPUT convert ARGS --memory-budget 1 --convert reference.txt convert.mid)
+if(NOT convert MATCHES "MIDI file created successfully")
+    message(FATAL_ERROR "No MIDI file with --memory-budget 1 --convert:\n${convert}")
+endif()
+expect_same_file(reference.mid convert.mid)
+
+set(missing "${WORK_DIR}/missing")
+run_tool(OUTPUT spill ENV TMPDIR=${missing} TMP=${missing} TEMP=${missing}
+         ARGS --seed 5 --memory-budget 1 input.txt spill.txt spill.mid 50)
+if(NOT spill MATCHES "Error in temporary MIDI data")
+    message(FATAL_ERROR "--memory-budget did not use the spill file:\n${spill}")
+endif()
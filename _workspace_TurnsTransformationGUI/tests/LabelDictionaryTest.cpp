@@ -0,0 +1,91 @@
+// Turns Transformation Tool - Label Dictionary Test
+// Builds the label perfect hash for label sets of a few thousand and tens of
+// thousands of labels and checks every lookup, the eligibility bits and that
+// the tables stay linear in the label count. A label file without labels must
+// be rejected rather than fall back to the default labels.
+//
+// The dictionary is internal to the engine, so the test compiles it in.
+
+#include "../TurnsTransformation.cpp"
+
+int failures = 0;
+
+void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << "\n";
+        ++failures;
+    }
+}
+
+// Build the dictionary of `labelCount` generated labels; 0 stands for no label file
+void checkLabelSet(std::size_t labelCount) {
+    // Short and long labels, some duplicates and one default label
+    std::vector<std::string> labels;
+    for (std::size_t i = 0; i < labelCount; ++i) {
+        labels.push_back(i % 3 == 0 ? "LONG_GENERATED_LABEL_" + std::to_string(i) : "L" + std::to_string(i));
+    }
+    if (labelCount > 0) {
+        labels.push_back("L1");
+        labels.push_back("SPD");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    LabelDictionary dictionary = buildLabelDictionary(labelCount > 0 ? &labels : nullptr);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::string name = std::to_string(labelCount) + " labels: ";
+    std::cout << name << dictionary.names.size() << " interned, " << dictionary.slots.size() << " slots, "
+              << dictionary.displacements.size() << " buckets, " << elapsed.count() << " s\n";
+
+    std::size_t internedCount = dictionary.names.size();
+    check(dictionary.slots.size() <= 4 * internedCount && dictionary.displacements.size() <= internedCount,
+          name + "tables are not linear in the label count");
+    for (LabelId id = 0; id < internedCount; ++id) {
+        check(findLabelId(dictionary, dictionary.names[id]) == id, name + "wrong id for " + dictionary.names[id]);
+    }
+
+    // Listed labels are eligible; defaults only when no labels are given
+    for (const std::string& label : labels) {
+        check(labelIsEligible(dictionary, findLabelId(dictionary, label)), name + label + " is not eligible");
+    }
+    for (std::string_view label : DEFAULT_ELIGIBLE_LABELS) {
+        LabelId id = findLabelId(dictionary, label);
+        check(id != UNKNOWN_LABEL, name + "default label " + std::string(label) + " is missing");
+        bool listed = labelCount == 0 || label == "SPD";
+        check(labelIsEligible(dictionary, id) == listed, name + "wrong eligibility of " + std::string(label));
+    }
+
+    // Labels that were never interned
+    for (std::size_t i = 0; i < 1000; ++i) {
+        std::string unknown = "X" + std::to_string(i);
+        check(findLabelId(dictionary, unknown) == UNKNOWN_LABEL, name + unknown + " was found");
+    }
+    check(findLabelId(dictionary, "") == UNKNOWN_LABEL, name + "the empty label was found");
+}
+
+void checkEmptyLabelFile() {
+    std::vector<std::string> labels;
+    bool rejected = false;
+    try {
+        buildLabelDictionary(&labels);
+    } catch (const std::invalid_argument&) {
+        rejected = true;
+    }
+    check(rejected, "an empty label list was accepted");
+}
+
+int main() {
+    checkEmptyLabelFile();
+    for (std::size_t labelCount : {0, 3000, 5000, 50000}) {
+        try {
+            checkLabelSet(labelCount);
+        } catch (const std::exception& e) {
+            check(false, std::to_string(labelCount) + " labels: " + e.what());
+        }
+    }
+    if (failures > 0) {
+        std::cerr << failures << " checks failed\n";
+        return 1;
+    }
+    std::cout << "All label dictionary checks passed.\n";
+    return 0;
+}